@@ -378,6 +378,47 @@ namespace snarklib {
          : [modprime] "r" (inv_), [res] "r" (res_), [mod] "r" (mod_) \
          : "%rax", "%rdx", "cc", "memory")
 
+
+////////////////////////////////////////////////////////////////////////////////
+// Montgomery multiplication with MULX/ADCX/ADOX (BMI2 and ADX)
+//
+// CIOS method with two carry chains: ADOX adds the low halves of the
+// products and ADCX the high halves. The N + 2 limbs of the running
+// sum stay in registers t0, t1, ... whose roles rotate by one every
+// outer iteration, so the division by 2^64 is free. The limb shifted
+// out is always zero and becomes the new top limb.
+//
+
+// rdx = B[ofs], clear CF and OF
+#define MONTX_LOADB(ofs)                                \
+    "movq    " STR(ofs) "(%[B]), %%rdx        \n\t"     \
+    "xorl    %k[lo], %k[lo]                  \n\t"
+
+// tj:tj1 += A[ofs] * rdx
+#define MONTX_MULADD(ofs, tj, tj1)                              \
+    "mulxq   " STR(ofs) "(%[A]), %[lo], %[hi]  \n\t"            \
+    "adoxq   %[lo], %[" #tj "]                 \n\t"            \
+    "adcxq   %[hi], %[" #tj1 "]                \n\t"
+
+// rdx = t0 * inv, clear CF and OF
+#define MONTX_LOADU(t0)                                 \
+    "movq    %[" #t0 "], %%rdx                 \n\t"    \
+    "imulq   %[inv], %%rdx                    \n\t"     \
+    "xorl    %k[lo], %k[lo]                  \n\t"
+
+// tj:tj1 += M[ofs] * rdx
+#define MONTX_MULADDM(ofs, tj, tj1)                             \
+    "mulxq   " STR(ofs) "(%[M]), %[lo], %[hi]  \n\t"            \
+    "adoxq   %[lo], %[" #tj "]                 \n\t"            \
+    "adcxq   %[hi], %[" #tj1 "]                \n\t"
+
+// add pending carries of both chains into the top limbs
+#define MONTX_FOLD(tn, tn1)                             \
+    "movq    $0, %[lo]                        \n\t"     \
+    "adcxq   %[lo], %[" #tn1 "]                \n\t"    \
+    "adoxq   %[lo], %[" #tn "]                 \n\t"    \
+    "adoxq   %[lo], %[" #tn1 "]                \n\t"
+
 } // namespace snarklib
 
 #endif
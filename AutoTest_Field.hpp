@@ -1,12 +1,17 @@
 #ifndef _SNARKLIB_AUTOTEST_FIELD_HPP_
 #define _SNARKLIB_AUTOTEST_FIELD_HPP_
 
+#include <array>
+#include <cstdlib>
 #include <gmp.h>
+#include <memory>
 #include <string>
+#include <vector>
 #include "AutoTest.hpp"
 #include "algebra/fields/bigint.hpp"
 #include "BigInt.hpp"
 #include "FpX.hpp"
+#include "MontKernel.hpp"
 
 namespace snarklib {
 
@@ -449,6 +454,182 @@ private:
     const TFQE m_ell_0B, m_ell_VWB, m_ell_VVB;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// Montgomery kernel matches prime field arithmetic
+//
+
+#ifdef SNARKLIB_MONT_KERNEL
+template <typename T>
+class AutoTest_FieldMontKernel : public AutoTest
+{
+    typedef typename T::BaseType FP;
+    static const mp_size_t N = FP::numberLimbs();
+
+public:
+    AutoTest_FieldMontKernel(const T& a, const T& b)
+        : AutoTest(a, b),
+          m_A(a),
+          m_B(b)
+    {}
+
+    AutoTest_FieldMontKernel()
+        : AutoTest_FieldMontKernel{T::random(), T::random()}
+    {}
+
+    void runTest() {
+        // kernel works on integers, not the Montgomery form
+        const auto a = m_A[0].asBigInt(), b = m_B[0].asBigInt();
+        const auto m = FP::modulus().data();
+        BigInt<N> r;
+
+        MontKernel<N>::add(r.data(), a.data(), b.data(), m);
+        checkPass((m_A + m_B)[0].asBigInt() == r);
+
+        MontKernel<N>::sub(r.data(), a.data(), b.data(), m);
+        checkPass((m_A - m_B)[0].asBigInt() == r);
+
+        // a * b / R * R^2 / R = a * b
+        MontKernel<N>::mul(r.data(), a.data(), b.data(), m, T::params.inv());
+        MontKernel<N>::mul(r.data(), r.data(), T::params.Rsquared().data(), m, T::params.inv());
+        checkPass((m_A * m_B)[0].asBigInt() == r);
+
+        // a * b + b * b - a * a with one reduction
+        typename FP::Wide w, v;
+        FP::mulWide(w, m_A[0], m_B[0]);
+        FP::mulWide(v, m_B[0], m_B[0]);
+        FP::addWide(w, w, v);
+        FP::mulWide(v, m_A[0], m_A[0]);
+        FP::subWide(w, w, v);
+        checkPass((m_A * m_B + m_B * m_B - m_A * m_A)[0] == FP::reduceWide(w));
+
+        if (! m_A.isZero()) {
+            MontKernel<N>::neg(r.data(), a.data(), m);
+            checkPass((-m_A)[0].asBigInt() == r);
+        }
+    }
+
+private:
+    const T m_A, m_B;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// constant-time inversion matches mpn_gcdext() and prime field division
+// (only for moduli up to 256 bits)
+//
+
+template <typename T>
+class AutoTest_FieldMontInverse : public AutoTest
+{
+    typedef typename T::BaseType FP;
+    static const mp_size_t N = FP::numberLimbs();
+
+public:
+    AutoTest_FieldMontInverse(const T& a, const T& b)
+        : AutoTest(a, b),
+          m_A(a),
+          m_B(b)
+    {}
+
+    AutoTest_FieldMontInverse(const T& a)
+        : AutoTest_FieldMontInverse{a, T::random()}
+    {}
+
+    AutoTest_FieldMontInverse()
+        : AutoTest_FieldMontInverse{T::random()}
+    {}
+
+    void runTest() {
+        if (m_A.isZero()) return;
+
+        const auto a = m_A[0].asBigInt(), b = m_B[0].asBigInt();
+        const auto m = FP::modulus().data();
+        const BigInt<N> one(1ul);
+        BigInt<N> r;
+
+        // 1 / a
+        MontInverse<N>::invert(r.data(), a.data(), one.data(), m, T::params.inv());
+        checkPass(gcdextInverse(a) == r);
+
+        // b / a
+        MontInverse<N>::invert(r.data(), a.data(), b.data(), m, T::params.inv());
+        checkPass((m_B * inverse(m_A))[0].asBigInt() == r);
+    }
+
+private:
+    // a^-1 mod m from mpn_gcdext(), as in FpModel
+    static BigInt<N> gcdextInverse(const BigInt<N>& a) {
+        const auto& m = FP::modulus();
+        BigInt<N> g, u = a, v = m, r;
+        std::array<mp_limb_t, N+1> s;
+        mp_size_t sn;
+
+        const mp_size_t gn = mpn_gcdext(g.data(),
+                                        s.data(),
+                                        std::addressof(sn),
+                                        u.data(),
+                                        N,
+                                        v.data(),
+                                        N);
+
+        if (1 != gn || 1 != g.data()[0]) return BigInt<N>();
+
+        mp_limb_t q;
+
+        if (std::abs(sn) >= N) {
+            mpn_tdiv_qr(std::addressof(q), r.data(), 0, s.data(), std::abs(sn), m.data(), N);
+        } else {
+            mpn_zero(r.data(), N);
+            mpn_copyi(r.data(), s.data(), std::abs(sn));
+        }
+
+        if (sn < 0) mpn_sub_n(r.data(), m.data(), r.data(), N);
+
+        return r;
+    }
+
+    const T m_A, m_B;
+};
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// batch operations on vectors match element operations
+//
+
+template <typename T>
+class AutoTest_FieldBatch : public AutoTest
+{
+public:
+    AutoTest_FieldBatch(const std::size_t vecSize)
+        : AutoTest(vecSize),
+          m_A(vecSize + 1, T::zero()),
+          m_B(vecSize, T::zero())
+    {
+        for (auto& a : m_A) a = T::random();
+        for (auto& b : m_B) b = T::random();
+    }
+
+    void runTest() {
+        // first vector is longer, its last element is not touched
+        auto mulA = m_A, addA = m_A, subA = m_A;
+        batchMul(mulA, m_B);
+        batchAdd(addA, m_B);
+        batchSub(subA, m_B);
+
+        for (std::size_t i = 0; i < m_B.size(); ++i) {
+            checkPass(m_A[i] * m_B[i] == mulA[i]);
+            checkPass(m_A[i] + m_B[i] == addA[i]);
+            checkPass(m_A[i] - m_B[i] == subA[i]);
+        }
+
+        checkPass(m_A.back() == mulA.back());
+        checkPass(m_A.back() == addA.back());
+        checkPass(m_A.back() == subA.back());
+    }
+
+private:
+    std::vector<T> m_A, m_B;
+};
+
 } // namespace snarklib
 
 #endif
@@ -2,10 +2,12 @@
 #define _SNARKLIB_AUTOTEST_LAGRANGE_FFT_HPP_
 
 #include <cstdint>
+#include <memory>
 #include <vector>
 #include "AutoTest.hpp"
 #include "LagrangeFFT.hpp"
 #include "LagrangeFFTX.hpp"
+#include "ThreadPool.hpp"
 #include "qap/evaluation_domain.hpp"
 
 namespace snarklib {
@@ -398,6 +400,260 @@ private:
     std::vector<T> m_PB;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// multi-threaded FFT and iFFT match original
+//
+
+template <typename T, typename U>
+class AutoTest_LagrangeFFT_FFTThreads : public AutoTest
+{
+public:
+    AutoTest_LagrangeFFT_FFTThreads(const std::size_t min_size,
+                                    const std::size_t numThreads)
+        : AutoTest(min_size, numThreads),
+          m_min_size(min_size),
+          m_numThreads(numThreads),
+          m_FFT(min_size),
+          m_FFT_min_size(m_FFT->min_size()),
+          m_A(m_FFT_min_size, U::zero())
+    {
+        m_B.reserve(m_FFT_min_size);
+        for (std::size_t i = 0; i < m_FFT_min_size; ++i) {
+            m_B.emplace_back(T::random());
+            copyData(m_B[i], m_A[i]);
+        }
+    }
+
+    void runTest() {
+        ThreadPool pool(m_numThreads);
+
+        auto a = libsnark::get_evaluation_domain<U>(m_min_size);
+        a->FFT(m_A);
+
+        m_FFT->FFT(m_B, pool);
+
+        if (checkPass(m_A.size() == m_B.size())) {
+            for (std::size_t i = 0; i < m_A.size(); ++i) {
+                checkPass(sameData(m_A[i], m_B[i]));
+            }
+        }
+
+        a->iFFT(m_A);
+
+        m_FFT->iFFT(m_B, pool);
+
+        if (checkPass(m_A.size() == m_B.size())) {
+            for (std::size_t i = 0; i < m_A.size(); ++i) {
+                checkPass(sameData(m_A[i], m_B[i]));
+            }
+        }
+    }
+
+private:
+    const std::size_t m_min_size, m_numThreads;
+    LagrangeFFT<T> m_FFT;
+    const std::size_t m_FFT_min_size;
+    std::vector<U> m_A;
+    std::vector<T> m_B;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// cosetFFT and icosetFFT by the multiplicative generator (the QAP coset)
+// match original
+//
+
+template <typename T, typename U>
+class AutoTest_LagrangeFFT_cosetGenerator : public AutoTest
+{
+public:
+    AutoTest_LagrangeFFT_cosetGenerator(const std::size_t min_size,
+                                        const std::size_t numThreads)
+        : AutoTest(min_size, numThreads),
+          m_min_size(min_size),
+          m_numThreads(numThreads),
+          m_FFT(min_size),
+          m_FFT_min_size(m_FFT->min_size()),
+          m_A(m_FFT_min_size, U::zero()),
+          m_gB(T::params.multiplicative_generator())
+    {
+        copyData(m_gB, m_gA);
+
+        m_B.reserve(m_FFT_min_size);
+        for (std::size_t i = 0; i < m_FFT_min_size; ++i) {
+            m_B.emplace_back(T::random());
+            copyData(m_B[i], m_A[i]);
+        }
+    }
+
+    void runTest() {
+        ThreadPool pool(m_numThreads);
+
+        auto a = libsnark::get_evaluation_domain<U>(m_min_size);
+        a->cosetFFT(m_A, m_gA);
+
+        m_FFT->cosetFFT(m_B, m_gB, pool);
+
+        if (checkPass(m_A.size() == m_B.size())) {
+            for (std::size_t i = 0; i < m_A.size(); ++i) {
+                checkPass(sameData(m_A[i], m_B[i]));
+            }
+        }
+
+        a->icosetFFT(m_A, m_gA);
+
+        m_FFT->icosetFFT(m_B, m_gB);
+
+        if (checkPass(m_A.size() == m_B.size())) {
+            for (std::size_t i = 0; i < m_A.size(); ++i) {
+                checkPass(sameData(m_A[i], m_B[i]));
+            }
+        }
+    }
+
+private:
+    const std::size_t m_min_size, m_numThreads;
+    LagrangeFFT<T> m_FFT;
+    const std::size_t m_FFT_min_size;
+    std::vector<U> m_A;
+    std::vector<T> m_B;
+    U m_gA;
+    const T m_gB;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// four-step FFT and iFFT match original
+//
+
+template <typename T, typename U>
+class AutoTest_LagrangeFFT_FourStep : public AutoTest
+{
+public:
+    AutoTest_LagrangeFFT_FourStep(const std::size_t min_size) // power of 2
+        : AutoTest(min_size),
+          m_min_size(min_size),
+          m_FFT(min_size),
+          m_A(min_size, U::zero())
+    {
+        m_B.reserve(min_size);
+        for (std::size_t i = 0; i < min_size; ++i) {
+            m_B.emplace_back(T::random());
+            copyData(m_B[i], m_A[i]);
+        }
+    }
+
+    void runTest() {
+        auto a = libsnark::get_evaluation_domain<U>(m_min_size);
+        a->FFT(m_A);
+
+        m_FFT.FFT(m_B);
+
+        if (checkPass(m_A.size() == m_B.size())) {
+            for (std::size_t i = 0; i < m_A.size(); ++i) {
+                checkPass(sameData(m_A[i], m_B[i]));
+            }
+        }
+
+        a->iFFT(m_A);
+
+        m_FFT.iFFT(m_B);
+
+        if (checkPass(m_A.size() == m_B.size())) {
+            for (std::size_t i = 0; i < m_A.size(); ++i) {
+                checkPass(sameData(m_A[i], m_B[i]));
+            }
+        }
+    }
+
+private:
+    const std::size_t m_min_size;
+    const fourstep_radix2_domain<T> m_FFT;
+    std::vector<U> m_A;
+    std::vector<T> m_B;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// batched transforms match one vector at a time
+//
+
+template <typename T>
+class AutoTest_LagrangeFFT_batchFFT : public AutoTest
+{
+public:
+    AutoTest_LagrangeFFT_batchFFT(const std::size_t min_size,
+                                  const std::size_t numVecs)
+        : AutoTest(min_size, numVecs),
+          m_FFT(min_size),
+          m_A(numVecs)
+    {
+        for (auto& v : m_A) {
+            v.reserve(m_FFT->min_size());
+            for (std::size_t i = 0; i < m_FFT->min_size(); ++i) {
+                v.emplace_back(T::random());
+            }
+        }
+    }
+
+    void runTest() {
+        const T g = T::params.multiplicative_generator();
+
+        auto B = m_A;
+        std::vector<std::vector<T>*> batch;
+        for (auto& v : B) {
+            batch.push_back(std::addressof(v));
+        }
+
+        m_FFT->iFFT(batch);
+        m_FFT->cosetFFT(batch, g);
+
+        for (auto& v : m_A) {
+            m_FFT->iFFT(v);
+            m_FFT->cosetFFT(v, g);
+        }
+
+        checkPass(m_A == B);
+    }
+
+private:
+    LagrangeFFT<T> m_FFT;
+    std::vector<std::vector<T>> m_A;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// evaluation domains are shared across threads
+//
+
+template <typename T>
+class AutoTest_LagrangeFFT_domainCache : public AutoTest
+{
+public:
+    AutoTest_LagrangeFFT_domainCache(const std::size_t min_size,
+                                     const std::size_t numThreads)
+        : AutoTest(min_size, numThreads),
+          m_min_size(min_size),
+          m_numThreads(numThreads)
+    {}
+
+    void runTest() {
+        std::vector<const typename LagrangeFFT<T>::Base*> domains(m_numThreads, nullptr);
+
+        ThreadPool pool(m_numThreads);
+        pool.run(m_numThreads,
+                 [this, &domains] (const std::size_t block) {
+                     const LagrangeFFT<T> F(m_min_size);
+                     domains[block] = std::addressof(*F);
+                 });
+
+        const LagrangeFFT<T> F(m_min_size);
+
+        for (const auto& d : domains) {
+            checkPass(std::addressof(*F) == d);
+        }
+    }
+
+private:
+    const std::size_t m_min_size, m_numThreads;
+};
+
 } // namespace snarklib
 
 #endif
@@ -1,7 +1,9 @@
 #ifndef _SNARKLIB_AUTOTEST_MULTIEXP_HPP_
 #define _SNARKLIB_AUTOTEST_MULTIEXP_HPP_
 
+#include <algorithm>
 #include <gmp.h>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include "algebra/fields/bigint.hpp"
@@ -10,6 +12,7 @@
 #include "common/wnaf.hpp"
 #include "encoding/multiexp.hpp"
 #include "MultiExp.hpp"
+#include "ThreadPool.hpp"
 
 namespace snarklib {
 
@@ -152,6 +155,188 @@ private:
     std::vector<G> m_scalarA;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// bucket multiple exponentiation matches max-heap version
+//
+
+template <typename T, typename F>
+class AutoTest_MultiExp_multiExpBucket : public AutoTest
+{
+public:
+    AutoTest_MultiExp_multiExpBucket(const std::size_t numTerms)
+        : AutoTest(numTerms),
+          m_numTerms(numTerms)
+    {
+        m_base.reserve(numTerms);
+        m_scalar.reserve(numTerms);
+
+        for (std::size_t i = 0; i < numTerms; ++i) {
+            m_base.emplace_back(T::random());
+            m_scalar.emplace_back(F::random());
+        }
+    }
+
+    void runTest() {
+        const auto a = multiExp(m_base, m_scalar);
+        const auto b = multiExpBucket(m_base, m_scalar);
+
+        checkPass(a == b);
+    }
+
+private:
+    const std::size_t m_numTerms;
+    std::vector<T> m_base;
+    std::vector<F> m_scalar;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// multi-threaded multiple exponentiation matches single-threaded
+//
+
+template <typename T, typename F>
+class AutoTest_MultiExp_multiExpThreads : public AutoTest
+{
+public:
+    AutoTest_MultiExp_multiExpThreads(const std::size_t numTerms,
+                                      const std::size_t numThreads)
+        : AutoTest(numTerms, numThreads),
+          m_numThreads(numThreads)
+    {
+        m_base.reserve(numTerms);
+        m_scalar.reserve(numTerms);
+
+        for (std::size_t i = 0; i < numTerms; ++i) {
+            m_base.emplace_back(T::random());
+
+            // mix of zero, one and random scalars for multiExp01
+            switch (i % 3) {
+            case (0) : m_scalar.emplace_back(F::zero()); break;
+            case (1) : m_scalar.emplace_back(F::one()); break;
+            default : m_scalar.emplace_back(F::random());
+            }
+        }
+
+        batchSpecial(m_base);
+    }
+
+    void runTest() {
+        ThreadPool pool(m_numThreads);
+
+        checkPass(multiExp(m_base, m_scalar) ==
+                  multiExp(m_base, m_scalar, pool));
+
+        checkPass(multiExp01(m_base, m_scalar) ==
+                  multiExp01(m_base, m_scalar, pool));
+    }
+
+private:
+    const std::size_t m_numThreads;
+    std::vector<T> m_base;
+    std::vector<F> m_scalar;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// exception thrown by one block reaches the caller, pool is still usable
+//
+
+template <typename T, typename F>
+class AutoTest_MultiExp_threadPoolException : public AutoTest
+{
+public:
+    AutoTest_MultiExp_threadPoolException(const std::size_t numTerms,
+                                          const std::size_t numThreads)
+        : AutoTest(numTerms, numThreads),
+          m_numThreads(numThreads)
+    {
+        m_base.reserve(numTerms);
+        m_scalar.reserve(numTerms);
+
+        for (std::size_t i = 0; i < numTerms; ++i) {
+            m_base.emplace_back(T::random());
+            m_scalar.emplace_back(F::random());
+        }
+    }
+
+    void runTest() {
+        ThreadPool pool(m_numThreads);
+        const std::size_t numBlocks = 4 * m_numThreads;
+
+        for (std::size_t badBlock = 0; badBlock < numBlocks; ++badBlock) {
+            bool caught = false;
+
+            try {
+                pool.run(numBlocks,
+                         [badBlock] (const std::size_t block) {
+                             if (badBlock == block)
+                                 throw std::runtime_error("block failed");
+                         });
+            } catch (const std::runtime_error&) {
+                caught = true;
+            }
+
+            checkPass(caught);
+        }
+
+        checkPass(multiExp(m_base, m_scalar) ==
+                  multiExp(m_base, m_scalar, pool));
+    }
+
+private:
+    const std::size_t m_numThreads;
+    std::vector<T> m_base;
+    std::vector<F> m_scalar;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// index range multiple exponentiation matches copied subvector
+//
+
+template <typename T, typename F>
+class AutoTest_MultiExp_multiExpRange : public AutoTest
+{
+public:
+    AutoTest_MultiExp_multiExpRange(const std::size_t numTerms,
+                                    const std::size_t startIndex)
+        : AutoTest(numTerms, startIndex),
+          m_startIndex(std::min(startIndex, numTerms))
+    {
+        m_base.reserve(numTerms);
+
+        for (std::size_t i = 0; i < numTerms; ++i) {
+            m_base.emplace_back(T::random());
+
+            if (i >= m_startIndex) {
+                // mix of zero, one and random scalars for multiExp01
+                switch (i % 3) {
+                case (0) : m_scalar.emplace_back(F::zero()); break;
+                case (1) : m_scalar.emplace_back(F::one()); break;
+                default : m_scalar.emplace_back(F::random());
+                }
+            }
+        }
+
+        batchSpecial(m_base);
+    }
+
+    void runTest() {
+        const std::vector<T> base(m_base.begin() + m_startIndex, m_base.end());
+
+        // same arena for both calls
+        MultiExpArena<T, F> arena;
+
+        checkPass(multiExp(base, m_scalar) ==
+                  multiExp(m_base, m_scalar, m_startIndex, m_base.size(), arena));
+
+        checkPass(multiExp01(base, m_scalar) ==
+                  multiExp01(m_base, m_scalar, m_startIndex, m_base.size(), 0, arena));
+    }
+
+private:
+    const std::size_t m_startIndex;
+    std::vector<T> m_base;
+    std::vector<F> m_scalar;
+};
+
 } // namespace snarklib
 
 #endif
@@ -14,6 +14,7 @@
 #include "PPZK_proof.hpp"
 #include "PPZK_verify.hpp"
 #include "r1cs_ppzksnark/r1cs_ppzksnark.hpp"
+#include "ThreadPool.hpp"
 
 namespace snarklib {
 
@@ -385,6 +386,18 @@ public:
                                       proofB);
 
         checkPass(ans);
+
+        // same proof with the witness multi-exponentiations on a thread pool
+        ThreadPool pool(4);
+        const PPZK_Proof<PAIRING> proofThreads(m_constraintSystem.systemB(),
+                                               m_constraintSystem.numberInputs(),
+                                               keypair.pk(),
+                                               m_constraintSystem.witnessB(),
+                                               proofRand,
+                                               0,
+                                               pool);
+
+        checkPass(proofB == proofThreads);
     }
 
 private:
@@ -13,6 +13,7 @@
 #include "encoding/knowledge_commitment.hpp"
 #include "encoding/multiexp.hpp"
 #include "Pairing.hpp"
+#include "ThreadPool.hpp"
 #include "WindowExp.hpp"
 
 namespace snarklib {
@@ -401,6 +402,65 @@ private:
     std::size_t m_minIndex, m_maxIndex;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// multi-threaded sparse multiExp01 matches single-threaded on a
+// sub-range of indices
+//
+
+template <typename TG, typename TH, typename TF>
+class AutoTest_Pairing_multiExp01Threads : public AutoTest
+{
+public:
+    AutoTest_Pairing_multiExp01Threads(const std::size_t vecSize,
+                                       const std::size_t numThreads)
+        : AutoTest(vecSize, numThreads),
+          m_numThreads(numThreads),
+          m_base(vecSize, Pairing<TG, TH>::zero())
+    {
+        std::random_device rd;
+        std::size_t idx = 0;
+
+        for (std::size_t i = 0; i < vecSize; ++i) {
+            m_base.setIndexElement(
+                i,
+                idx,
+                Pairing<TG, TH>(TG::random(), TH::random()));
+
+            idx += 1 + rd() % 10;
+        }
+
+        batchSpecial(m_base);
+
+        // narrow index range inside [0, idx]
+        m_minIndex = idx / 3;
+        m_maxIndex = idx / 2;
+
+        const std::size_t scalarSize = m_maxIndex - m_minIndex + 1;
+        m_scalar.reserve(scalarSize);
+        for (std::size_t i = 0; i < scalarSize; ++i) {
+            // mix of zero, one and random scalars
+            switch (i % 3) {
+            case (0) : m_scalar.emplace_back(TF::zero()); break;
+            case (1) : m_scalar.emplace_back(TF::one()); break;
+            default : m_scalar.emplace_back(TF::random());
+            }
+        }
+    }
+
+    void runTest() {
+        ThreadPool pool(m_numThreads);
+
+        checkPass(multiExp01(m_base, m_scalar, m_minIndex, m_maxIndex) ==
+                  multiExp01(m_base, m_scalar, m_minIndex, m_maxIndex, 0, pool));
+    }
+
+private:
+    const std::size_t m_numThreads;
+    SparseVector<Pairing<TG, TH>> m_base;
+    std::vector<TF> m_scalar;
+    std::size_t m_minIndex, m_maxIndex;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // compare map-reduce with monolithic batchExp
 //
@@ -8,6 +8,7 @@
 #include "qap/qap.hpp"
 #include "Rank1DSL.hpp"
 #include "r1cs/r1cs.hpp"
+#include "ThreadPool.hpp"
 
 namespace snarklib {
 
@@ -147,13 +148,12 @@ private:
         QAP_WitnessA<T> aA(qap, m_constraintSystem.witnessB());
         QAP_WitnessB<T> aB(qap, m_constraintSystem.witnessB());
         QAP_WitnessC<T> aC(qap, m_constraintSystem.witnessB());
-        QAP_WitnessH<T> aH(qap, aA, aB, m_d1B, m_d2B, m_d3B);
 
         aA.cosetFFT();
         aB.cosetFFT();
         aC.cosetFFT();
 
-        aH.addTemporary(QAP_WitnessH<T>(qap, aA, aB, aC));
+        const QAP_WitnessH<T> aH(qap, aA, aB, aC, m_d1B, m_d2B, m_d3B);
 
         return aH.vec();
     }
@@ -163,6 +163,156 @@ private:
     const T m_d1B, m_d2B, m_d3B;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// QAP witness H computed in place matches regular plus temporary H
+//
+
+template <typename T, typename U>
+class AutoTest_QAP_WitnessH_inPlace : public AutoTest
+{
+public:
+    AutoTest_QAP_WitnessH_inPlace(const AutoTestR1CS<T, U>& cs)
+        : AutoTest(cs),
+          m_constraintSystem(cs),
+          m_d1(T::random()),
+          m_d2(T::random()),
+          m_d3(T::random())
+    {}
+
+    void runTest() {
+        const QAP_SystemPoint<T> qap(m_constraintSystem.systemB(),
+                                     m_constraintSystem.numberInputs());
+
+        const auto& witness = m_constraintSystem.witnessB();
+
+        QAP_WitnessA<T> aA(qap, witness);
+        QAP_WitnessB<T> aB(qap, witness);
+        QAP_WitnessC<T> aC(qap, witness);
+
+        // regular H
+        std::vector<T> H(qap.degree() + 1, T::zero());
+        for (std::size_t i = 0; i < qap.degree(); ++i)
+            H[i] = m_d2 * aA.vec()[i] + m_d1 * aB.vec()[i];
+
+        H[0] -= m_d3;
+        qap.FFT()->add_poly_Z(m_d1 * m_d2, H);
+
+        aA.cosetFFT();
+        aB.cosetFFT();
+        aC.cosetFFT();
+
+        // temporary H
+        std::vector<T> tmpH(qap.degree(), T::zero());
+        for (std::size_t i = 0; i < tmpH.size(); ++i)
+            tmpH[i] = aA.vec()[i] * aB.vec()[i] - aC.vec()[i];
+
+        qap.FFT()->divide_by_Z_on_coset(tmpH);
+        qap.FFT()->icosetFFT(tmpH, T::params.multiplicative_generator());
+
+        for (std::size_t i = 0; i < tmpH.size(); ++i)
+            H[i] += tmpH[i];
+
+        const QAP_WitnessH<T> aH(qap, aA, aB, aC, m_d1, m_d2, m_d3);
+
+        checkPass(H == aH.vec());
+        checkPass(aA.vec().empty() && aB.vec().empty() && aC.vec().empty());
+    }
+
+private:
+    const AutoTestR1CS<T, U> m_constraintSystem;
+    const T m_d1, m_d2, m_d3;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// multi-threaded query vectors
+//
+
+template <typename T, typename U>
+class AutoTest_QAP_QueryThreads : public AutoTest
+{
+public:
+    AutoTest_QAP_QueryThreads(const AutoTestR1CS<T, U>& cs,
+                              const std::size_t numThreads)
+        : AutoTest(cs, numThreads),
+          m_constraintSystem(cs),
+          m_numThreads(numThreads)
+    {}
+
+    void runTest() {
+        const QAP_SystemPoint<T> qap(m_constraintSystem.systemB(),
+                                     m_constraintSystem.numberInputs(),
+                                     T::random());
+
+        ThreadPool pool(m_numThreads);
+
+        const QAP_QueryA<T> A1(qap), A2(qap, pool);
+        const QAP_QueryB<T> B1(qap), B2(qap, pool);
+        const QAP_QueryC<T> C1(qap), C2(qap, pool);
+        const QAP_QueryH<T> H1(qap), H2(qap, pool);
+
+        checkPass(A1.vec() == A2.vec() && A1.nonzeroCount() == A2.nonzeroCount());
+        checkPass(B1.vec() == B2.vec() && B1.nonzeroCount() == B2.nonzeroCount());
+        checkPass(C1.vec() == C2.vec() && C1.nonzeroCount() == C2.nonzeroCount());
+        checkPass(H1.vec() == H2.vec() && H1.nonzeroCount() == H2.nonzeroCount());
+
+        const T rA = T::random(), rB = T::random(), beta = T::random();
+        const QAP_QueryK<T> K1(qap, A1, B1, C1, rA, rB, beta);
+        const QAP_QueryK<T> K2(qap, A1, B1, C1, rA, rB, beta, pool);
+
+        checkPass(K1.vec() == K2.vec());
+    }
+
+private:
+    const AutoTestR1CS<T, U> m_constraintSystem;
+    const std::size_t m_numThreads;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// witness vectors A, B, C filled together
+//
+
+template <typename T, typename U>
+class AutoTest_QAP_WitnessFillABC : public AutoTest
+{
+public:
+    AutoTest_QAP_WitnessFillABC(const AutoTestR1CS<T, U>& cs,
+                                const std::size_t numThreads)
+        : AutoTest(cs, numThreads),
+          m_constraintSystem(cs),
+          m_numThreads(numThreads)
+    {}
+
+    void runTest() {
+        const QAP_SystemPoint<T> qap(m_constraintSystem.systemB(),
+                                     m_constraintSystem.numberInputs());
+
+        const auto& witness = m_constraintSystem.witnessB();
+
+        const QAP_WitnessA<T> aA(qap, witness);
+        const QAP_WitnessB<T> aB(qap, witness);
+        const QAP_WitnessC<T> aC(qap, witness);
+
+        std::vector<std::vector<T>*> batch1, batch2;
+        QAP_WitnessA<T> xA(qap, batch1), yA(qap, batch2);
+        QAP_WitnessB<T> xB(qap, batch1), yB(qap, batch2);
+        QAP_WitnessC<T> xC(qap, batch1), yC(qap, batch2);
+
+        ThreadPool pool(m_numThreads);
+        fillWitnessABC(qap, witness, xA, xB, xC);
+        fillWitnessABC(qap, witness, yA, yB, yC, pool);
+
+        qap.FFT()->iFFT(batch1);
+        qap.FFT()->iFFT(batch2, pool);
+
+        checkPass(aA.vec() == xA.vec() && aB.vec() == xB.vec() && aC.vec() == xC.vec());
+        checkPass(aA.vec() == yA.vec() && aB.vec() == yB.vec() && aC.vec() == yC.vec());
+    }
+
+private:
+    const AutoTestR1CS<T, U> m_constraintSystem;
+    const std::size_t m_numThreads;
+};
+
 } // namespace snarklib
 
 #endif
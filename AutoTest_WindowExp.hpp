@@ -6,6 +6,7 @@
 #include "AutoTest.hpp"
 #include "AuxSTL.hpp"
 #include "encoding/multiexp.hpp"
+#include "ThreadPool.hpp"
 #include "WindowExp.hpp"
 
 namespace snarklib {
@@ -286,6 +287,164 @@ private:
     std::vector<F> m_vec;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// signed-digit window table exponentiation matches unsigned
+//
+
+template <typename T, typename F>
+class AutoTest_WindowExp_expSigned : public AutoTest
+{
+public:
+    AutoTest_WindowExp_expSigned(const std::size_t exp_count,
+                                 const F& value)
+        : AutoTest(exp_count, value),
+          m_exp_count(exp_count),
+          m_value(value)
+    {}
+
+    AutoTest_WindowExp_expSigned(const std::size_t exp_count)
+        : AutoTest_WindowExp_expSigned{exp_count, F::random()}
+    {}
+
+    void runTest() {
+        const WindowExp<T> A(m_exp_count);
+        const auto result_A = A.exp(m_value);
+
+        const WindowExp<T> B(m_exp_count, true);
+        if (! checkPass(result_A == B.exp(m_value))) return;
+
+        const auto space = WindowExp<T>::space(m_exp_count, true);
+
+        // try all possible block partitionings
+        for (std::size_t numBlocks = 1; numBlocks <= space.globalID()[0]; ++numBlocks) {
+            auto idx = space;
+            idx.blockPartition(std::array<std::size_t, 1>{ numBlocks });
+
+            auto result_C = T::zero();
+
+            for (std::size_t block = 0; block < numBlocks; ++block) {
+                const WindowExp<T> C(idx, block);
+                result_C = result_C + C.exp(m_value);
+            }
+
+            checkPass(result_A == result_C);
+        }
+    }
+
+private:
+    const std::size_t m_exp_count;
+    const F m_value;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// window table exponentiation unchanged by conversion to special form
+// (mixed addition of table entries)
+//
+
+template <typename T, typename F>
+class AutoTest_WindowExp_expSpecial : public AutoTest
+{
+public:
+    AutoTest_WindowExp_expSpecial(const std::size_t exp_count,
+                                  const F& value)
+        : AutoTest(exp_count, value),
+          m_exp_count(exp_count),
+          m_value(value)
+    {}
+
+    AutoTest_WindowExp_expSpecial(const std::size_t exp_count)
+        : AutoTest_WindowExp_expSpecial{exp_count, F::random()}
+    {}
+
+    void runTest() {
+        const WindowExp<T> A(m_exp_count);
+
+        WindowExp<T> B(m_exp_count);
+        B.batchSpecial();
+
+        // signed digits subtract negated special entries
+        WindowExp<T> C(m_exp_count, true);
+        C.batchSpecial();
+
+        const auto result_A = A.exp(m_value);
+        checkPass(result_A == B.exp(m_value));
+        checkPass(result_A == C.exp(m_value));
+    }
+
+private:
+    const std::size_t m_exp_count;
+    const F m_value;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// window table built on thread pool matches serial construction
+//
+
+template <typename T, typename F>
+class AutoTest_WindowExp_expThreads : public AutoTest
+{
+public:
+    AutoTest_WindowExp_expThreads(const std::size_t exp_count,
+                                  const std::size_t numThreads)
+        : AutoTest(exp_count, numThreads),
+          m_exp_count(exp_count),
+          m_numThreads(numThreads),
+          m_value(F::random())
+    {}
+
+    void runTest() {
+        ThreadPool pool(m_numThreads);
+
+        const WindowExp<T> A(m_exp_count), B(m_exp_count, pool);
+
+        checkPass(A.exp(m_value) == B.exp(m_value));
+    }
+
+private:
+    const std::size_t m_exp_count, m_numThreads;
+    const F m_value;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// multi-threaded batch exponentiation matches single-threaded
+//
+
+template <typename T, typename F>
+class AutoTest_WindowExp_batchExpThreads : public AutoTest
+{
+public:
+    AutoTest_WindowExp_batchExpThreads(const std::size_t exp_count,
+                                       const std::size_t vecSize,
+                                       const std::size_t numThreads)
+        : AutoTest(exp_count, vecSize, numThreads),
+          m_exp_count(exp_count),
+          m_numThreads(numThreads)
+    {
+        m_vec.reserve(vecSize);
+        for (std::size_t i = 0; i < vecSize; ++i)
+            m_vec.emplace_back(F::random());
+    }
+
+    void runTest() {
+        ThreadPool pool(m_numThreads);
+
+        const WindowExp<T> A(m_exp_count);
+
+        auto result_A = A.batchExp(m_vec);
+        auto result_B = A.batchExp(m_vec, pool);
+        if (! checkPass(result_A == result_B)) return;
+
+        // accumulate
+        A.batchExp(result_A, m_vec);
+        A.batchExp(result_B, m_vec, pool);
+        checkPass(result_A == result_B);
+    }
+
+private:
+    const std::size_t m_exp_count, m_numThreads;
+    std::vector<F> m_vec;
+};
+
 } // namespace snarklib
 
 #endif
@@ -4,7 +4,9 @@
 #include <algorithm>
 #include <array>
 #include <cstdint>
+#include <cstdlib>
 #include <iostream>
+#include <new>
 #include <istream>
 #include <ostream>
 #include <queue>
@@ -57,6 +59,54 @@ public:
     std::size_t capacity() const {
         return this->c.capacity();
     }
+
+    // empty the queue but keep the memory
+    void clear() {
+        this->c.clear();
+    }
+
+    // ok to change the top element if its order is unchanged
+    using std::priority_queue<T>::top;
+    T& top() {
+        return this->c.front();
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// STL allocator aligned to cache lines
+// Used for large tables read sequentially, e.g. WindowExp.
+//
+
+template <typename T>
+class CacheAlignedAllocator
+{
+public:
+    typedef T value_type;
+
+    static constexpr std::size_t ALIGNMENT = 64;
+
+    CacheAlignedAllocator() = default;
+
+    template <typename U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U>&) {}
+
+    T* allocate(const std::size_t n) {
+        void* p = nullptr;
+        if (posix_memalign(&p, ALIGNMENT, n * sizeof(T)))
+            throw std::bad_alloc();
+
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, const std::size_t) {
+        free(p);
+    }
+
+    template <typename U>
+    bool operator== (const CacheAlignedAllocator<U>&) const { return true; }
+
+    template <typename U>
+    bool operator!= (const CacheAlignedAllocator<U>&) const { return false; }
 };
 
 ////////////////////////////////////////////////////////////////////////////////
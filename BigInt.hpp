@@ -252,6 +252,24 @@ public:
         }
     }
 
+    // window of w bits starting at bit i (w less than limb size)
+    unsigned long getBits(const std::size_t i, const std::size_t w) const {
+        const std::size_t part = i / GMP_NUMB_BITS;
+        const std::size_t bit = i - (GMP_NUMB_BITS * part);
+
+        if (part >= N) {
+            return 0;
+        }
+
+        unsigned long v = m_data[part] >> bit;
+
+        if (bit + w > GMP_NUMB_BITS && part + 1 < N) {
+            v |= m_data[part + 1] << (GMP_NUMB_BITS - bit);
+        }
+
+        return v & ((1ul << w) - 1);
+    }
+
     void clearBit(const std::size_t i) {
         const std::size_t part = i / GMP_NUMB_BITS;
         const std::size_t bit = i - (GMP_NUMB_BITS * part);
@@ -0,0 +1,66 @@
+#ifndef _SNARKLIB_CPU_FEATURES_HPP_
+#define _SNARKLIB_CPU_FEATURES_HPP_
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+namespace snarklib {
+
+////////////////////////////////////////////////////////////////////////////////
+// Runtime CPU feature detection
+//
+// CPUID is queried once, the answers are cached. Code paths that need
+// instruction set extensions check here so the same binary runs on
+// older processors.
+//
+
+class CpuFeatures
+{
+public:
+    // MULX (BMI2) and ADCX/ADOX (ADX)
+    static bool adx() {
+        static const bool a = leaf7ebx(BMI2_BIT) && leaf7ebx(ADX_BIT);
+        return a;
+    }
+
+    // AVX-512 foundation and integer fused multiply-add (52 bit)
+    static bool avx512ifma() {
+        static const bool a =
+            leaf7ebx(AVX512F_BIT) && leaf7ebx(AVX512IFMA_BIT) && zmmState();
+        return a;
+    }
+
+private:
+    // CPUID leaf 7, subleaf 0, register EBX
+    static const unsigned int
+        AVX512F_BIT = 16, BMI2_BIT = 8, ADX_BIT = 19, AVX512IFMA_BIT = 21;
+
+    static bool leaf7ebx(const unsigned int bit) {
+#if defined(__x86_64__)
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+            return (ebx >> bit) & 1;
+#endif
+        return false;
+    }
+
+    // operating system saves opmask and ZMM registers
+    static bool zmmState() {
+#if defined(__x86_64__)
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_OSXSAVE)) {
+            unsigned int xcr0, xcr0hi;
+            __asm__ ("xgetbv" : "=a" (xcr0), "=d" (xcr0hi) : "c" (0));
+
+            // SSE, AVX, opmask, ZMM0-15 upper, ZMM16-31
+            return 0xe6 == (xcr0 & 0xe6);
+        }
+#endif
+        return false;
+    }
+};
+
+} // namespace snarklib
+
+#endif
@@ -307,9 +307,9 @@ public:
         return GROUP(X3, Y3, Z3);
     }
 
-    template <typename GROUP>
+    template <typename GROUP, typename ALLOC>
     static
-    std::vector<GROUP>& batchSpecial(std::vector<GROUP>& vec) {
+    std::vector<GROUP, ALLOC>& batchSpecial(std::vector<GROUP, ALLOC>& vec) {
         std::vector<typename GROUP::BaseField> Z_vec;
         for (const auto& a : vec) {
             if (! a.isZero())
@@ -2,10 +2,12 @@
 #define _SNARKLIB_FIELD_HPP_
 
 #include <array>
+#include <cassert>
 #include <cstdint>
 #include <istream>
 #include <ostream>
 #include <string>
+#include <vector>
 
 namespace snarklib {
 
@@ -298,6 +300,55 @@ void invert(Field<T, N>& x)
     // Field<T, N> inverse(const Field<T, N>&)
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Batch operations on vectors
+//
+// a[i] op= b[i] for every element of b (a may be longer). These are
+// element loops. The F[p] specialization of batchMul() multiplies
+// several elements at once when the processor supports it.
+//
+
+// multiplication in-place
+template <typename T, std::size_t N>
+void batchMul(std::vector<Field<T, N>>& a,
+              const std::vector<Field<T, N>>& b)
+{
+#ifdef USE_ASSERT
+    assert(a.size() >= b.size());
+#endif
+
+    for (std::size_t i = 0; i < b.size(); ++i)
+        a[i] *= b[i];
+    // specialization:
+    // void batchMul(std::vector<Field<T, N>>&, const std::vector<Field<T, N>>&)
+}
+
+// addition in-place
+template <typename T, std::size_t N>
+void batchAdd(std::vector<Field<T, N>>& a,
+              const std::vector<Field<T, N>>& b)
+{
+#ifdef USE_ASSERT
+    assert(a.size() >= b.size());
+#endif
+
+    for (std::size_t i = 0; i < b.size(); ++i)
+        a[i] += b[i];
+}
+
+// subtraction in-place
+template <typename T, std::size_t N>
+void batchSub(std::vector<Field<T, N>>& a,
+              const std::vector<Field<T, N>>& b)
+{
+#ifdef USE_ASSERT
+    assert(a.size() >= b.size());
+#endif
+
+    for (std::size_t i = 0; i < b.size(); ++i)
+        a[i] -= b[i];
+}
+
 } // namespace snarklib
 
 #endif
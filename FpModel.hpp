@@ -10,8 +10,11 @@
 #include <memory>
 #include <ostream>
 #include <string>
+#include <type_traits>
+#include <vector>
 #include "BigInt.hpp"
 #include "Field.hpp"
+#include "MontKernel.hpp"
 
 namespace snarklib {
 
@@ -142,12 +145,18 @@ public:
         }
         void non_residue(const FNRF& a) {
             m_non_residue = a;
+            m_non_residue_minus_one = (-FNRF::one() == a);
         }
         void non_residue(const char* a) {
-            m_non_residue = FNRF(a);
+            non_residue(FNRF(a));
         }
         void non_residue(const char* a, const char* b) {
-            m_non_residue = FNRF(a, b);
+            non_residue(FNRF(a, b));
+        }
+
+        // F[p^2] multiplication with lazy reduction needs this
+        bool non_residue_minus_one() const {
+            return m_non_residue_minus_one;
         }
 
         // Frobenius_coeffs_c1
@@ -219,6 +228,7 @@ public:
         mp_limb_t m_inv;
 
         // used by: Fp2, Fp3, Fp23, Fp32, Fp232
+        static bool m_non_residue_minus_one;
         static
         FNRF
             m_non_residue,
@@ -339,7 +349,11 @@ public:
 
         } else {
             FpModel r;
+#ifdef SNARKLIB_MONT_KERNEL
+            MontKernel<N>::neg(r.m_monty.data(), m_monty.data(), MODULUS.data());
+#else
             mpn_sub_n(r.m_monty.data(), MODULUS.data(), m_monty.data(), N);
+#endif
             return r;
         }
     }
@@ -347,53 +361,51 @@ public:
     // squaring is optimized with assembler code
     FpModel squared() const; // asm
 
-    // inversion in-place
-    FpModel& invert() {
-#ifdef USE_ASSERT
-        assert(! isZero());
-#endif
+    // a[i] *= b[i] for every element of b, eight at a time when the
+    // processor has AVX-512 IFMA
+    static void batchMul(std::vector<Fp>& a, const std::vector<Fp>& b); // asm
 
-        BigInt<N> g, v = MODULUS;
-        std::array<mp_limb_t, N+1> s;
-        mp_size_t sn;
-
-        const mp_size_t gn = mpn_gcdext(g.data(),
-                                        s.data(),
-                                        std::addressof(sn),
-                                        m_monty.data(),
-                                        N,
-                                        v.data(),
-                                        N);
+#ifdef SNARKLIB_MONT_KERNEL
+    // double width values for lazy reduction, less than MODULUS * R
+    typedef std::array<mp_limb_t, 2 * N> Wide;
 
-#ifdef USE_ASSERT
-        assert(1 == gn && 1 == g.data()[0]);
-#endif
+    // r = a * b without reduction
+    static void mulWide(Wide& r, const FpModel& a, const FpModel& b) {
+        MontKernel<N>::mulWide(r.data(), a.m_monty.data(), b.m_monty.data());
+    }
 
-        mp_limb_t q;
+    // r = a + b mod MODULUS * R
+    static void addWide(Wide& r, const Wide& a, const Wide& b) {
+        MontKernel<N>::addWide(r.data(), a.data(), b.data(), MODULUS.data());
+    }
 
-        if (std::abs(sn) >= N) {
-            mpn_tdiv_qr(std::addressof(q),
-                        m_monty.data(),
-                        0,
-                        s.data(),
-                        std::abs(sn),
-                        MODULUS.data(),
-                        N);
-        } else {
-            mpn_zero(m_monty.data(), N);
-            mpn_copyi(m_monty.data(), s.data(), std::abs(sn));
-        }
+    // r = a - b mod MODULUS * R
+    static void subWide(Wide& r, const Wide& a, const Wide& b) {
+        MontKernel<N>::subWide(r.data(), a.data(), b.data(), MODULUS.data());
+    }
 
-        if (sn < 0) {
-            const mp_limb_t borrow
-                = mpn_sub_n(m_monty.data(), MODULUS.data(), m_monty.data(), N);
+    // one Montgomery reduction for any number of products
+    static FpModel reduceWide(const Wide& a) {
+        FpModel r;
+        MontKernel<N>::reduceWide(r.m_monty.data(),
+                                  a.data(),
+                                  MODULUS.data(),
+                                  Fp::params.inv());
+        return r;
+    }
+#endif
 
+    // inversion in-place, constant-time if USE_SAFEGCD is defined
+    FpModel& invert() {
 #ifdef USE_ASSERT
-            assert(0 == borrow);
+        assert(! isZero());
 #endif
-        }
 
-        mulReduce(Fp::params.Rcubed()); // asm
+#if defined(USE_SAFEGCD) && defined(SNARKLIB_MONT_KERNEL)
+        invertSafe(HasMontInverse<N>());
+#else
+        invertGCD();
+#endif
         return *this;
     }
 
@@ -436,6 +448,66 @@ public:
 private:
     void mulReduce(const BigInt<N>& other); // asm
 
+#if defined(USE_SAFEGCD) && defined(SNARKLIB_MONT_KERNEL)
+    // constant-time, (aR)^-1 * R^2 = a^-1 R stays in Montgomery form
+    void invertSafe(std::true_type) {
+        MontInverse<N>::invert(m_monty.data(),
+                               m_monty.data(),
+                               Fp::params.Rsquared().data(),
+                               MODULUS.data(),
+                               Fp::params.inv());
+    }
+
+    // no divstep bound for larger moduli
+    void invertSafe(std::false_type) {
+        invertGCD();
+    }
+#endif
+
+    void invertGCD() {
+        BigInt<N> g, v = MODULUS;
+        std::array<mp_limb_t, N+1> s;
+        mp_size_t sn;
+
+        const mp_size_t gn = mpn_gcdext(g.data(),
+                                        s.data(),
+                                        std::addressof(sn),
+                                        m_monty.data(),
+                                        N,
+                                        v.data(),
+                                        N);
+
+#ifdef USE_ASSERT
+        assert(1 == gn && 1 == g.data()[0]);
+#endif
+
+        mp_limb_t q;
+
+        if (std::abs(sn) >= N) {
+            mpn_tdiv_qr(std::addressof(q),
+                        m_monty.data(),
+                        0,
+                        s.data(),
+                        std::abs(sn),
+                        MODULUS.data(),
+                        N);
+        } else {
+            mpn_zero(m_monty.data(), N);
+            mpn_copyi(m_monty.data(), s.data(), std::abs(sn));
+        }
+
+        if (sn < 0) {
+            const mp_limb_t borrow
+                = mpn_sub_n(m_monty.data(), MODULUS.data(), m_monty.data(), N);
+
+#ifdef USE_ASSERT
+            assert(0 == borrow);
+#endif
+        }
+
+        mulReduce(Fp::params.Rcubed()); // asm
+    }
+
     BigInt<N> m_monty;
 };
 
@@ -452,6 +524,10 @@ template <typename T>
 typename FpModel<N, MODULUS>::template Params<T>::FNRF
 FpModel<N, MODULUS>::Params<T>::m_non_residue;
 
+template <mp_size_t N, const BigInt<N>& MODULUS>
+template <typename T>
+bool FpModel<N, MODULUS>::Params<T>::m_non_residue_minus_one;
+
 template <mp_size_t N, const BigInt<N>& MODULUS>
 template <typename T>
 typename FpModel<N, MODULUS>::template Params<T>::FNRF
@@ -529,6 +605,13 @@ Field<FpModel<N, MODULUS>>& operator*= (Field<FpModel<N, MODULUS>>& x,
     return x;
 }
 
+// batch multiplication in-place: F[p] *= F[p] for vectors
+template <mp_size_t N, const BigInt<N>& MODULUS>
+void batchMul(std::vector<Field<FpModel<N, MODULUS>>>& a,
+              const std::vector<Field<FpModel<N, MODULUS>>>& b) {
+    FpModel<N, MODULUS>::batchMul(a, b);
+}
+
 // inverse
 template <mp_size_t N, const BigInt<N>& MODULUS>
 Field<FpModel<N, MODULUS>> inverse(const Field<FpModel<N, MODULUS>>& x) {
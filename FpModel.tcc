@@ -2,7 +2,10 @@
 #define _SNARKLIB_FP_MODEL_TCC_
 
 #include "AsmMacros.hpp"
+#include "CpuFeatures.hpp"
 #include "FpModel.hpp"
+#include "MontBatch.hpp"
+#include "MontKernel.hpp"
 
 namespace snarklib {
 
@@ -106,6 +109,14 @@ FpModel<N, MODULUS>::operator+= (const FpModel<N, MODULUS>& other)
     }
     else
 #endif
+#ifdef SNARKLIB_MONT_KERNEL
+    {
+        MontKernel<N>::add(m_monty.data(),
+                           m_monty.data(),
+                           other.m_monty.data(),
+                           MODULUS.data());
+    }
+#else
     {
         std::array<mp_limb_t, N+1> scratch;
         const mp_limb_t carry = mpn_add_n(scratch.data(),
@@ -126,6 +137,7 @@ FpModel<N, MODULUS>::operator+= (const FpModel<N, MODULUS>& other)
 
         mpn_copyi(m_monty.data(), scratch.data(), N);
     }
+#endif
 
     return *this;
 }
@@ -201,6 +213,14 @@ FpModel<N, MODULUS>::operator-= (const FpModel<N, MODULUS>& other)
     }
     else
 #endif
+#ifdef SNARKLIB_MONT_KERNEL
+    {
+        MontKernel<N>::sub(m_monty.data(),
+                           m_monty.data(),
+                           other.m_monty.data(),
+                           MODULUS.data());
+    }
+#else
     {
         std::array<mp_limb_t, N+1> scratch;
         if (mpn_cmp(m_monty.data(), other.m_monty.data(), N) < 0)
@@ -226,6 +246,7 @@ FpModel<N, MODULUS>::operator-= (const FpModel<N, MODULUS>& other)
 
         mpn_copyi(m_monty.data(), scratch.data(), N);
     }
+#endif
 
     return *this;
 }
@@ -288,6 +309,77 @@ template <mp_size_t N, const BigInt<N>& MODULUS>
 void FpModel<N, MODULUS>::mulReduce(const BigInt<N>& other)
 {
     /* stupid pre-processor tricks; beware */
+#if defined(__x86_64__) && defined(USE_ASM) && defined(SNARKLIB_MONT_KERNEL)
+    if (4 == N && CpuFeatures::adx())
+    { // use MULX/ADCX/ADOX interleaved multiplication and reduction
+        const mp_limb_t inv = Fp::params.inv();
+        mp_limb_t t0 = 0, t1 = 0, t2 = 0, t3 = 0, t4 = 0, t5 = 0, lo, hi;
+        __asm__
+            (MONTX_LOADB(0)
+             MONTX_MULADD(0, t0, t1)
+             MONTX_MULADD(8, t1, t2)
+             MONTX_MULADD(16, t2, t3)
+             MONTX_MULADD(24, t3, t4)
+             MONTX_FOLD(t4, t5)
+             MONTX_LOADU(t0)
+             MONTX_MULADDM(0, t0, t1)
+             MONTX_MULADDM(8, t1, t2)
+             MONTX_MULADDM(16, t2, t3)
+             MONTX_MULADDM(24, t3, t4)
+             MONTX_FOLD(t4, t5)
+             MONTX_LOADB(8)
+             MONTX_MULADD(0, t1, t2)
+             MONTX_MULADD(8, t2, t3)
+             MONTX_MULADD(16, t3, t4)
+             MONTX_MULADD(24, t4, t5)
+             MONTX_FOLD(t5, t0)
+             MONTX_LOADU(t1)
+             MONTX_MULADDM(0, t1, t2)
+             MONTX_MULADDM(8, t2, t3)
+             MONTX_MULADDM(16, t3, t4)
+             MONTX_MULADDM(24, t4, t5)
+             MONTX_FOLD(t5, t0)
+             MONTX_LOADB(16)
+             MONTX_MULADD(0, t2, t3)
+             MONTX_MULADD(8, t3, t4)
+             MONTX_MULADD(16, t4, t5)
+             MONTX_MULADD(24, t5, t0)
+             MONTX_FOLD(t0, t1)
+             MONTX_LOADU(t2)
+             MONTX_MULADDM(0, t2, t3)
+             MONTX_MULADDM(8, t3, t4)
+             MONTX_MULADDM(16, t4, t5)
+             MONTX_MULADDM(24, t5, t0)
+             MONTX_FOLD(t0, t1)
+             MONTX_LOADB(24)
+             MONTX_MULADD(0, t3, t4)
+             MONTX_MULADD(8, t4, t5)
+             MONTX_MULADD(16, t5, t0)
+             MONTX_MULADD(24, t0, t1)
+             MONTX_FOLD(t1, t2)
+             MONTX_LOADU(t3)
+             MONTX_MULADDM(0, t3, t4)
+             MONTX_MULADDM(8, t4, t5)
+             MONTX_MULADDM(16, t5, t0)
+             MONTX_MULADDM(24, t0, t1)
+             MONTX_FOLD(t1, t2)
+             : [t0] "+r" (t0),
+               [t1] "+r" (t1),
+               [t2] "+r" (t2),
+               [t3] "+r" (t3),
+               [t4] "+r" (t4),
+               [t5] "+r" (t5),
+               [lo] "=&r" (lo), [hi] "=&r" (hi)
+             : [A] "r" (m_monty.data()), [B] "r" (other.data()),
+               [M] "r" (MODULUS.data()), [inv] "m" (inv)
+             : "cc", "memory", "%rdx");
+
+        // rotated registers hold the 4 limbs of t and the carry
+        const mp_limb_t t[5] = { t4, t5, t0, t1, t2 };
+        MontKernel<N>::reduce(m_monty.data(), t, t[4], MODULUS.data());
+    }
+    else
+#endif
 #if defined(__x86_64__) && defined(USE_ASM)
     if (3 == N)
     { // Use asm-optimized Comba multiplication and reduction
@@ -425,6 +517,15 @@ void FpModel<N, MODULUS>::mulReduce(const BigInt<N>& other)
     }
     else
 #endif
+#ifdef SNARKLIB_MONT_KERNEL
+    {
+        MontKernel<N>::mul(m_monty.data(),
+                           m_monty.data(),
+                           other.data(),
+                           MODULUS.data(),
+                           Fp::params.inv());
+    }
+#else
     {
         std::array<mp_limb_t, 2*N> res;
         mpn_mul_n(res.data(), m_monty.data(), other.data(), N);
@@ -464,6 +565,44 @@ void FpModel<N, MODULUS>::mulReduce(const BigInt<N>& other)
 
         mpn_copyi(m_monty.data(), res.data() + N, N);
     }
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// batchMul
+//
+
+template <mp_size_t N, const BigInt<N>& MODULUS>
+void FpModel<N, MODULUS>::batchMul(std::vector<Fp>& a,
+                                   const std::vector<Fp>& b)
+{
+#ifdef USE_ASSERT
+    assert(a.size() >= b.size());
+#endif
+
+    std::size_t i = 0;
+
+#ifdef SNARKLIB_MONT_BATCH
+    if (CpuFeatures::avx512ifma())
+    { // use AVX-512 IFMA kernel for groups of eight elements
+        typedef MontBatch<N> K;
+
+        mp_limb_t* r[K::LANES];
+        const mp_limb_t* s[K::LANES];
+
+        for (; i + K::LANES <= b.size(); i += K::LANES) {
+            for (std::size_t k = 0; k < K::LANES; ++k) {
+                r[k] = a[i + k][0].m_monty.data();
+                s[k] = b[i + k][0].m_monty.data();
+            }
+
+            K::mul(r, r, s, MODULUS.data(), Fp::params.inv());
+        }
+    }
+#endif
+
+    for (; i < b.size(); ++i)
+        a[i][0] *= b[i][0];
 }
 
 #undef COMMA
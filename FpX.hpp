@@ -10,6 +10,82 @@
 
 namespace snarklib {
 
+////////////////////////////////////////////////////////////////////////////////
+// F[p^2] lazy reduction
+//
+// With non-residue -1, coefficients of F[p^2] products are sums and
+// differences of F[p] products. These are accumulated in double width
+// and reduced once for each coefficient of the result (Aranha, Karabina,
+// Longa, Gebotys, Lopez, "Faster Explicit Formulas for Computing
+// Pairings over Ordinary Curves"). The results are identical.
+//
+
+#ifdef SNARKLIB_MONT_KERNEL
+
+template <mp_size_t N, const BigInt<N>& MODULUS>
+class Fp2Wide
+{
+    typedef FpModel<N, MODULUS> Fp;
+    typedef Field<Fp, 2> Fp2;
+
+public:
+    // only for non-residue -1
+    static bool enabled() {
+        return Fp2::params.non_residue_minus_one();
+    }
+
+    // x * y without reduction (Karatsuba)
+    Fp2Wide(const Fp2& x, const Fp2& y) {
+        typename Fp::Wide bB;
+        Fp::mulWide(m_c[0], x[0], y[0]);
+        Fp::mulWide(bB, x[1], y[1]);
+        Fp::mulWide(m_c[1], x[0] + x[1], y[0] + y[1]);
+
+        // aA - bB, (a + b)(A + B) - aA - bB
+        Fp::subWide(m_c[1], m_c[1], m_c[0]);
+        Fp::subWide(m_c[1], m_c[1], bB);
+        Fp::subWide(m_c[0], m_c[0], bB);
+    }
+
+    Fp2Wide& operator+= (const Fp2Wide& other) {
+        Fp::addWide(m_c[0], m_c[0], other.m_c[0]);
+        Fp::addWide(m_c[1], m_c[1], other.m_c[1]);
+        return *this;
+    }
+
+    Fp2Wide& operator-= (const Fp2Wide& other) {
+        Fp::subWide(m_c[0], m_c[0], other.m_c[0]);
+        Fp::subWide(m_c[1], m_c[1], other.m_c[1]);
+        return *this;
+    }
+
+    Fp2 reduce() const {
+        return {
+            Fp::reduceWide(m_c[0]),
+            Fp::reduceWide(m_c[1])
+        };
+    }
+
+private:
+    std::array<typename Fp::Wide, 2> m_c;
+};
+
+template <mp_size_t N, const BigInt<N>& MODULUS>
+Fp2Wide<N, MODULUS> operator+ (const Fp2Wide<N, MODULUS>& x,
+                               const Fp2Wide<N, MODULUS>& y) {
+    auto a = x;
+    return a += y;
+}
+
+template <mp_size_t N, const BigInt<N>& MODULUS>
+Fp2Wide<N, MODULUS> operator- (const Fp2Wide<N, MODULUS>& x,
+                               const Fp2Wide<N, MODULUS>& y) {
+    auto a = x;
+    return a -= y;
+}
+
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 // F[p^2]
 //
@@ -20,6 +96,11 @@ Field<FpModel<N, MODULUS>, 2>&
 operator*= (Field<FpModel<N, MODULUS>, 2>& x,
             const Field<FpModel<N, MODULUS>, 2>& y)
 {
+#ifdef SNARKLIB_MONT_KERNEL
+    if (Fp2Wide<N, MODULUS>::enabled())
+        return x = Fp2Wide<N, MODULUS>(x, y).reduce();
+#endif
+
     const auto
         &A = y[0],
         &B = y[1],
@@ -61,6 +142,13 @@ squared(const Field<FpModel<N, MODULUS>, 2>& x)
 
     const auto ab = a * b;
 
+    // complex squaring: (a + b)(a - b) when non-residue is -1
+    if (Field<FpModel<N, MODULUS>, 2>::params.non_residue_minus_one())
+        return {
+            (a + b)*(a - b),
+            ab + ab
+        };
+
     const auto& NR = Field<FpModel<N, MODULUS>, 2>::params.non_residue()[0];
 
     return {
@@ -254,6 +342,29 @@ operator*= (Field<Field<FpModel<N, MODULUS>, 2>, 3>& x,
         &b = x[1],
         &c = x[2];
 
+#ifdef SNARKLIB_MONT_KERNEL
+    if (Fp2Wide<N, MODULUS>::enabled()) {
+        typedef Fp2Wide<N, MODULUS> W;
+
+        const auto& NR = Field<Field<FpModel<N, MODULUS>, 2>, 3>::params.non_residue();
+
+        const W
+            aA(a, A),
+            bB(b, B),
+            cC(c, C);
+
+        const W
+            beta_0(NR, (W(b + c, B + C) - bB - cC).reduce()),
+            beta_1(NR, cC.reduce());
+
+        return x = {
+            (aA + beta_0).reduce(),
+            (W(a + b, A + B) - aA - bB + beta_1).reduce(),
+            (W(a + c, A + C) - aA + bB - cC).reduce()
+        };
+    }
+#endif
+
     const auto
         aA = a * A,
         bB = b * B,
@@ -795,6 +906,51 @@ mul_by_024(const Field<Field<Field<FpModel<N, MODULUS>, 2>, 3>, 2>& x,
            const Field<FpModel<N, MODULUS>, 2>& ell_VW,
            const Field<FpModel<N, MODULUS>, 2>& ell_VV)
 {
+#ifdef SNARKLIB_MONT_KERNEL
+    if (Fp2Wide<N, MODULUS>::enabled()) {
+        typedef Fp2Wide<N, MODULUS> W;
+
+        const auto
+            &z0 = x[0][0],
+            &z1 = x[0][1],
+            &z2 = x[0][2],
+            &z3 = x[1][0],
+            &z4 = x[1][1],
+            &z5 = x[1][2];
+
+        const auto
+            &x0 = ell_0,
+            &x2 = ell_VV,
+            &x4 = ell_VW;
+
+        const auto& NR = Field<Field<FpModel<N, MODULUS>, 2>, 3>::params.non_residue();
+
+        const W
+            D0(z0, x0),
+            D2(z2, x2),
+            D4(z4, x4),
+            z1x2(z1, x2),
+            z5x4(z5, x4),
+            z1x0(z1, x0),
+            z3x4(z3, x4),
+            z3x0(z3, x0),
+            z5x2(z5, x2);
+
+        const auto S1 = z1x2 + z5x4 + z1x0 + z3x4 + z3x0 + z5x2;
+
+        return {
+            Field<Field<FpModel<N, MODULUS>, 2>, 3>(
+                (W(NR, (z1x2 + D4).reduce()) + D0).reduce(),
+                (W(NR, (z5x4 + D2).reduce()) + z1x0).reduce(),
+                (W(z0 + z2, x0 + x2) - D0 - D2 + z3x4).reduce()),
+            Field<Field<FpModel<N, MODULUS>, 2>, 3>(
+                (W(NR, (W(z2 + z4, x2 + x4) - D2 - D4).reduce()) + z3x0).reduce(),
+                (W(NR, z5x2.reduce()) + W(z0 + z4, x0 + x4) - D0 - D4).reduce(),
+                (W(z1 + z3 + z5, x0 + x2 + x4) - S1).reduce())
+        };
+    }
+#endif
+
     auto
         z0 = x[0][0],
         z1 = x[0][1],
@@ -301,9 +301,9 @@ Group<BASE, SCALAR, CURVE> operator* (const Field<FpModel<N, MODULUS>>& exponent
 }
 
 // batch conversion to special (batch_invert() makes it faster)
-template <typename BASE, typename SCALAR, typename CURVE>
-std::vector<Group<BASE, SCALAR, CURVE>>&
-batchSpecial(std::vector<Group<BASE, SCALAR, CURVE>>& vec) {
+template <typename BASE, typename SCALAR, typename CURVE, typename ALLOC>
+std::vector<Group<BASE, SCALAR, CURVE>, ALLOC>&
+batchSpecial(std::vector<Group<BASE, SCALAR, CURVE>, ALLOC>& vec) {
     return CURVE::batchSpecial(vec);
 }
 
@@ -4,16 +4,108 @@
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
 #include <vector>
 #include "Field.hpp"
 #include "FpModel.hpp"
 #include "FpX.hpp"
+#include "ThreadPool.hpp"
 #include "Util.hpp"
 
 namespace snarklib {
 
+////////////////////////////////////////////////////////////////////////////////
+// Process-wide cache of powers of field elements
+// Twiddle factors for each transform size are computed once and shared
+// by all evaluation domains and threads.
+//
+
+template <typename T>
+class PowersCache
+{
+public:
+    typedef std::shared_ptr<const std::vector<T>> Table;
+
+    // returns [1, g, g^2, ...] with at least count elements, a larger
+    // table for the same g replaces the smaller one
+    static Table powers(const T& g, const std::size_t count) {
+        auto& c = instance();
+        Table old;
+
+        {
+            std::lock_guard<std::mutex> lock(c.m_mutex);
+
+            const auto it = c.find(g);
+            if (it != c.m_tables.end()) {
+                if (it->second->size() >= count)
+                    return it->second;
+
+                old = it->second;
+            }
+        }
+
+        // computed without the lock, extending the smaller table
+        auto v = std::make_shared<std::vector<T>>();
+        v->reserve(count);
+
+        if (old) v->assign(old->begin(), old->end());
+
+        T u = v->empty() ? T::one() : v->back() * g;
+        while (v->size() < count) {
+            v->emplace_back(u);
+            u *= g;
+        }
+
+        std::lock_guard<std::mutex> lock(c.m_mutex);
+
+        const auto it = c.find(g);
+        if (it == c.m_tables.end()) {
+            c.m_tables.emplace_back(g, v);
+        } else if (it->second->size() >= count) {
+            // another thread got there first
+            return it->second;
+        } else {
+            it->second = v;
+        }
+
+        return v;
+    }
+
+    // releases tables not in use
+    static void clear() {
+        auto& c = instance();
+        std::lock_guard<std::mutex> lock(c.m_mutex);
+
+        c.m_tables.clear();
+    }
+
+private:
+    PowersCache() = default;
+
+    static PowersCache& instance() {
+        static PowersCache c;
+        return c;
+    }
+
+    typename std::vector<std::pair<T, Table>>::iterator find(const T& g) {
+        return std::find_if(m_tables.begin(),
+                            m_tables.end(),
+                            [&g] (const std::pair<T, Table>& r) {
+                                return r.first == g;
+                            });
+    }
+
+    std::mutex m_mutex;
+    std::vector<std::pair<T, Table>> m_tables;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // Evaluate Lagrange polynomials
+// Domains are kept in a process-wide cache for each field and size so
+// repeated QAP construction (every proof and keypair) shares the roots
+// and tables.
 //
 
 template <typename T>
@@ -32,24 +124,107 @@ public:
 #ifdef USE_ASSERT
             assert(a.size() == min_size());
 #endif
-            m_FFT(a);
+            m_FFT(a, nullptr, nullptr);
+        }
+
+        // multi-threaded, same result as single-threaded
+        void FFT(std::vector<T>& a, ThreadPool& pool) const {
+#ifdef USE_ASSERT
+            assert(a.size() == min_size());
+#endif
+            m_FFT(a, nullptr, std::addressof(pool));
         }
 
         void iFFT(std::vector<T>& a) const {
 #ifdef USE_ASSERT
             assert(a.size() == min_size());
 #endif
-            m_iFFT(a);
+            m_iFFT(a, nullptr, nullptr);
+        }
+
+        // multi-threaded, same result as single-threaded
+        void iFFT(std::vector<T>& a, ThreadPool& pool) const {
+#ifdef USE_ASSERT
+            assert(a.size() == min_size());
+#endif
+            m_iFFT(a, nullptr, std::addressof(pool));
         }
 
         void cosetFFT(std::vector<T>& a, const T& g) const {
-            multiply_by_coset(a, g);
-            FFT(a);
+            coset_FFT(a, g, nullptr);
+        }
+
+        void cosetFFT(std::vector<T>& a, const T& g, ThreadPool& pool) const {
+            coset_FFT(a, g, std::addressof(pool));
         }
 
         void icosetFFT(std::vector<T>& a, const T& g) const {
-            iFFT(a);
-            multiply_by_coset(a, inverse(g));
+            icoset_FFT(a, g, nullptr);
+        }
+
+        void icosetFFT(std::vector<T>& a, const T& g, ThreadPool& pool) const {
+            icoset_FFT(a, g, std::addressof(pool));
+        }
+
+        // batched transforms of equal length vectors in one pass
+        void FFT(const std::vector<std::vector<T>*>& a) const {
+#ifdef USE_ASSERT
+            assert(same_size(a));
+#endif
+            m_batchFFT(a, nullptr, nullptr);
+        }
+
+        void FFT(const std::vector<std::vector<T>*>& a, ThreadPool& pool) const {
+#ifdef USE_ASSERT
+            assert(same_size(a));
+#endif
+            m_batchFFT(a, nullptr, std::addressof(pool));
+        }
+
+        void iFFT(const std::vector<std::vector<T>*>& a) const {
+#ifdef USE_ASSERT
+            assert(same_size(a));
+#endif
+            m_batchiFFT(a, nullptr, nullptr);
+        }
+
+        void iFFT(const std::vector<std::vector<T>*>& a, ThreadPool& pool) const {
+#ifdef USE_ASSERT
+            assert(same_size(a));
+#endif
+            m_batchiFFT(a, nullptr, std::addressof(pool));
+        }
+
+        void cosetFFT(const std::vector<std::vector<T>*>& a, const T& g) const {
+#ifdef USE_ASSERT
+            assert(same_size(a));
+#endif
+            batch_coset_FFT(a, g, nullptr);
+        }
+
+        void cosetFFT(const std::vector<std::vector<T>*>& a,
+                      const T& g,
+                      ThreadPool& pool) const {
+#ifdef USE_ASSERT
+            assert(same_size(a));
+#endif
+            batch_coset_FFT(a, g, std::addressof(pool));
+        }
+
+        void icosetFFT(const std::vector<std::vector<T>*>& a, const T& g) const {
+#ifdef USE_ASSERT
+            assert(same_size(a));
+#endif
+            batch_icoset_FFT(a, g, nullptr);
+        }
+
+        void icosetFFT(const std::vector<std::vector<T>*>& a,
+                       const T& g,
+                       ThreadPool& pool) const {
+#ifdef USE_ASSERT
+            assert(same_size(a));
+#endif
+            batch_icoset_FFT(a, g, std::addressof(pool));
         }
 
         virtual std::vector<T> lagrange_coeffs(const T& t) const = 0;
@@ -71,8 +246,70 @@ public:
         }
 
     protected:
-        virtual void m_FFT(std::vector<T>& a) const = 0;
-        virtual void m_iFFT(std::vector<T>& a) const = 0;
+        // powers g^i of a coset generator computed as lo[i % s] * hi[i / s]
+        // from two tables of about sqrt(n) elements, no n-entry table
+        class Coset
+        {
+        public:
+            Coset(const T& g, const std::size_t n)
+                : m_g(g),
+                  m_shift(ceil_log2(n) / 2),
+                  m_mask((std::size_t(1) << m_shift) - 1)
+            {
+                T u = T::one();
+                for (std::size_t i = 0; i <= m_mask; ++i) {
+                    m_lo.emplace_back(u);
+                    u *= g;
+                }
+
+                const T gs = u;
+                u = T::one();
+                for (std::size_t i = 0; i <= (n >> m_shift); ++i) {
+                    m_hi.emplace_back(u);
+                    u *= gs;
+                }
+            }
+
+            const T& g() const {
+                return m_g;
+            }
+
+            T operator[] (const std::size_t i) const {
+                return m_lo[i & m_mask] * m_hi[i >> m_shift];
+            }
+
+        private:
+            const T m_g;
+            const std::size_t m_shift, m_mask;
+            std::vector<T> m_lo, m_hi;
+        };
+
+        // coset is null or the powers g^i multiplied into a[i] before
+        // the FFT and after the iFFT, pool is null for single-threaded
+        virtual void m_FFT(std::vector<T>& a,
+                           const Coset* coset,
+                           ThreadPool* pool) const = 0;
+        virtual void m_iFFT(std::vector<T>& a,
+                            const Coset* coset,
+                            ThreadPool* pool) const = 0;
+
+        // default is one vector at a time
+        virtual void m_batchFFT(const std::vector<std::vector<T>*>& a,
+                                const Coset* coset,
+                                ThreadPool* pool) const {
+            for (const auto v : a) {
+                m_FFT(*v, coset, pool);
+            }
+        }
+
+        virtual void m_batchiFFT(const std::vector<std::vector<T>*>& a,
+                                 const Coset* coset,
+                                 ThreadPool* pool) const {
+            for (const auto v : a) {
+                m_iFFT(*v, coset, pool);
+            }
+        }
+
         virtual void m_add_poly_Z(const T& coeff, std::vector<T>& H) const = 0;
 
         Base(const std::size_t min_size)
@@ -98,30 +335,68 @@ public:
             return squared(T::params.multiplicative_generator());
         }
 
-        void basic_radix2_FFT(std::vector<T>& a, const T& omega) const {
-            const std::size_t n = a.size();
-            const std::size_t logn = ceil_log2(n);
+        // omega must be a root of unity of order a.size()
+        // coset powers are multiplied in during bit-reversal
+        void basic_radix2_FFT(std::vector<T>& a,
+                              const T& omega,
+                              ThreadPool* pool = nullptr,
+                              const Coset* coset = nullptr) const {
+            batch_radix2_FFT(std::vector<T*>(1, a.data()), a.size(), omega, pool, coset);
+        }
+
+        // transforms several vectors of length n together, the
+        // twiddle factors of each butterfly group stay in cache for all
+        // of the vectors
+        void batch_radix2_FFT(const std::vector<T*>& a,
+                              const std::size_t n,
+                              const T& omega,
+                              ThreadPool* pool = nullptr,
+                              const Coset* coset = nullptr) const {
 #ifdef USE_ASSERT
-            assert(n == (1u << logn));
+            assert(n == (1u << ceil_log2(n)));
 #endif
 
-            for (std::size_t k = 0; k < n; ++k) {
-                const std::size_t rk = bit_reverse(k, logn);
-                if (k < rk)
-                    std::swap(a[k], a[rk]);
+            // w_m^j is twiddle[j * n / (2 * m)]
+            const auto twiddle = PowersCache<T>::powers(omega, n / 2);
+            const auto& tw = *twiddle;
+
+            if (pool && pool->numThreads() > 1) {
+                parallel_radix2_FFT(a, n, tw, coset, *pool);
+            } else {
+                radix2_FFT(a.data(), a.size(), n, tw.data(), 1, coset);
+            }
+        }
+
+        // in-place transform of a[0, n) where w_m^j is
+        // tw[j * twStride * n / (2 * m)], twStride is for sub-transforms
+        // sharing the twiddle table of a larger transform
+        static void radix2_FFT(T* a,
+                               const std::size_t n,
+                               const T* tw,
+                               const std::size_t twStride) {
+            radix2_FFT(&a, 1, n, tw, twStride, nullptr);
+        }
+
+        // same for numVecs vectors
+        static void radix2_FFT(T* const* a,
+                               const std::size_t numVecs,
+                               const std::size_t n,
+                               const T* tw,
+                               const std::size_t twStride,
+                               const Coset* coset) {
+            const std::size_t logn = ceil_log2(n);
+
+            for (std::size_t v = 0; v < numVecs; ++v) {
+                bit_reverse_coset(a[v], coset, logn, 0, n);
             }
 
             std::size_t m = 1;
             for (std::size_t s = 1; s <= logn; ++s) {
-                const T w_m = omega ^ (n / (2 * m));
+                const std::size_t stride = twStride * n / (2 * m);
 
                 for (std::size_t k = 0; k < n; k += 2*m) {
-                    T w = T::one();
-                    for (std::size_t j = 0; j < m; ++j) {
-                        const T t = w * a[k + j + m];
-                        a[k + j + m] = a[k + j] - t;
-                        a[k + j] += t;
-                        w *= w_m;
+                    for (std::size_t v = 0; v < numVecs; ++v) {
+                        butterflies(a[v] + k, 0, m, m, tw, stride);
                     }
                 }
 
@@ -129,12 +404,164 @@ public:
             }
         }
 
-        void multiply_by_coset(std::vector<T>& a, const T& g) const {
-            T u = g;
+        // butterflies of elements j and j + m for j in [startJ, stopJ)
+        static void butterflies(T* a,
+                                const std::size_t startJ,
+                                const std::size_t stopJ,
+                                const std::size_t m,
+                                const T* tw,
+                                const std::size_t stride) {
+            for (std::size_t j = startJ; j < stopJ; ++j) {
+                const T t = tw[j * stride] * a[j + m];
+                a[j + m] = a[j] - t;
+                a[j] += t;
+            }
+        }
+
+        // Early stages have many butterfly groups which are split across
+        // threads. Late stages have fewer groups than threads so the
+        // j-loop inside each group is split instead.
+        void parallel_radix2_FFT(const std::vector<T*>& a,
+                                 const std::size_t n,
+                                 const std::vector<T>& tw,
+                                 const Coset* coset,
+                                 ThreadPool& pool) const {
+            const std::size_t logn = ceil_log2(n);
+
+            pool.blockPartition(
+                n,
+                [&a, coset, logn] (const std::size_t block,
+                                   const std::size_t startIndex,
+                                   const std::size_t stopIndex) {
+                    for (const auto v : a) {
+                        bit_reverse_coset(v, coset, logn, startIndex, stopIndex);
+                    }
+                });
+
+            std::size_t m = 1;
+            for (std::size_t s = 1; s <= logn; ++s) {
+                // number of groups is also the twiddle stride
+                const std::size_t stride = n / (2 * m);
+                const std::size_t numGroups = stride;
+
+                if (numGroups >= pool.numThreads()) {
+                    pool.blockPartition(
+                        numGroups,
+                        [&a, &tw, m, stride] (const std::size_t block,
+                                              const std::size_t startGroup,
+                                              const std::size_t stopGroup) {
+                            for (std::size_t g = startGroup; g < stopGroup; ++g) {
+                                const std::size_t k = 2 * m * g;
+
+                                for (const auto v : a) {
+                                    butterflies(v + k, 0, m, m, tw.data(), stride);
+                                }
+                            }
+                        });
+
+                } else {
+                    pool.blockPartition(
+                        m,
+                        [&a, &tw, m, n, stride] (const std::size_t block,
+                                                 const std::size_t startJ,
+                                                 const std::size_t stopJ) {
+                            for (std::size_t k = 0; k < n; k += 2*m) {
+                                for (const auto v : a) {
+                                    butterflies(v + k, startJ, stopJ, m, tw.data(), stride);
+                                }
+                            }
+                        });
+                }
+
+                m *= 2;
+            }
+        }
+
+        // bit-reversal permutation of indices [startIndex, stopIndex)
+        // and their partners, each swapped pair belongs to the lower index
+        static void bit_reverse_coset(T* a,
+                                      const Coset* coset,
+                                      const std::size_t logn,
+                                      const std::size_t startIndex,
+                                      const std::size_t stopIndex) {
+            for (std::size_t k = startIndex; k < stopIndex; ++k) {
+                const std::size_t rk = bit_reverse(k, logn);
+
+                if (k < rk) {
+                    std::swap(a[k], a[rk]);
+
+                    if (coset) {
+                        a[k] *= (*coset)[rk];
+                        a[rk] *= (*coset)[k];
+                    }
+
+                } else if (k == rk && coset) {
+                    a[k] *= (*coset)[k];
+                }
+            }
+        }
+
+#ifdef USE_ASSERT
+        bool same_size(const std::vector<std::vector<T>*>& a) const {
+            for (const auto v : a) {
+                if (v->size() != min_size()) return false;
+            }
+
+            return true;
+        }
+#endif
+
+        void batch_coset_FFT(const std::vector<std::vector<T>*>& a,
+                             const T& g,
+                             ThreadPool* pool) const {
+            const Coset coset(g, min_size());
+            m_batchFFT(a, std::addressof(coset), pool);
+        }
+
+        void batch_icoset_FFT(const std::vector<std::vector<T>*>& a,
+                              const T& g,
+                              ThreadPool* pool) const {
+            const Coset coset(inverse(g), min_size());
+            m_batchiFFT(a, std::addressof(coset), pool);
+        }
+
+        // coset powers are applied inside the transform
+        void coset_FFT(std::vector<T>& a, const T& g, ThreadPool* pool) const {
+#ifdef USE_ASSERT
+            assert(a.size() == min_size());
+#endif
+            const Coset coset(g, a.size());
+            m_FFT(a, std::addressof(coset), pool);
+        }
+
+        void icoset_FFT(std::vector<T>& a, const T& g, ThreadPool* pool) const {
+#ifdef USE_ASSERT
+            assert(a.size() == min_size());
+#endif
+            const Coset coset(inverse(g), a.size());
+            m_iFFT(a, std::addressof(coset), pool);
+        }
+
+        // a[i] times the coset power if not null
+        static T coset_times(const std::vector<T>& a,
+                             const std::size_t i,
+                             const Coset* coset) {
+            return coset ? a[i] * (*coset)[i] : a[i];
+        }
+
+        // multiply every element by c and the coset power if not null
+        static void scale(std::vector<T>& a, const T& c, const Coset* coset) {
+            if (coset) {
+                T u = c;
 
-            for (std::size_t i = 1; i < a.size(); ++i) {
-                a[i] *= u;
-                u *= g;
+                for (std::size_t i = 0; i < a.size(); ++i) {
+                    a[i] *= u;
+                    u *= coset->g();
+                }
+            } else {
+                for (std::size_t i = 0; i < a.size(); ++i) {
+                    a[i] *= c;
+                }
             }
         }
 
@@ -150,6 +577,7 @@ public:
             const T omega = get_root_of_unity(m);
 
             std::vector<T> u(m, T::zero());
+            u.reserve(m + 1);
 
             if (T::one() == (t ^ m)) {
                 T omega_i = T::one();
@@ -164,16 +592,26 @@ public:
                 }
             }
 
-            const T Z = (t ^ m) - T::one();
-            T l = Z * inverse(T(m));
+            // denominators t - omega^i and m share one inversion
             T r = T::one();
 
             for (std::size_t i = 0; i < m; ++i) {
-                u[i] = l * inverse(t - r);
-                l *= omega;
+                u[i] = t - r;
                 r *= omega;
             }
 
+            u.push_back(T(m));
+            batch_invert(u);
+
+            const T Z = (t ^ m) - T::one();
+            T l = Z * u.back();
+            u.pop_back();
+
+            for (std::size_t i = 0; i < m; ++i) {
+                u[i] *= l;
+                l *= omega;
+            }
+
             return u;
         }
 
@@ -181,18 +619,13 @@ public:
         const std::size_t m_min_size;
     }; // class Base
 
+    // evaluation domains are shared, each size is constructed once
     LagrangeFFT(const std::size_t min_size)
-        : m_domain(
-            static_cast<LagrangeFFT<T>::Base*>(
-                get_evaluation_domain<T>(min_size)))
+        : m_domain(domain(min_size))
     {}
 
-    ~LagrangeFFT() {
-        delete m_domain;
-    }
-
     const Base* operator-> () const {
-        return m_domain;
+        return m_domain.get();
     }
 
     const Base& operator* () const {
@@ -221,8 +654,51 @@ public:
         }
     }
 
+    // releases cached domains and powers not in use by any LagrangeFFT
+    static void clearCache() {
+        {
+            auto& c = cache();
+            std::lock_guard<std::mutex> lock(c.m_mutex);
+
+            c.m_domains.clear();
+        }
+
+        PowersCache<T>::clear();
+    }
+
 private:
-    const Base* m_domain;
+    typedef std::shared_ptr<const Base> Domain;
+
+    struct DomainCache
+    {
+        std::mutex m_mutex;
+        std::vector<std::pair<std::size_t, Domain>> m_domains;
+    };
+
+    static DomainCache& cache() {
+        static DomainCache c;
+        return c;
+    }
+
+    static Domain domain(const std::size_t min_size) {
+        auto& c = cache();
+        std::lock_guard<std::mutex> lock(c.m_mutex);
+
+        for (const auto& r : c.m_domains) {
+            if (r.first == min_size)
+                return r.second;
+        }
+
+        const Domain d(
+            static_cast<LagrangeFFT<T>::Base*>(
+                get_evaluation_domain<T>(min_size)));
+
+        c.m_domains.emplace_back(min_size, d);
+
+        return d;
+    }
+
+    Domain m_domain;
 };
 
 } // namespace snarklib
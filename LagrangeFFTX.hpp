@@ -1,7 +1,11 @@
 #ifndef _SNARKLIB_LAGRANGE_FFT_X_HPP_
 #define _SNARKLIB_LAGRANGE_FFT_X_HPP_
 
+#include <algorithm>
+#include <cstdint>
+#include <vector>
 #include "LagrangeFFT.hpp"
+#include "ThreadPool.hpp"
 
 namespace snarklib {
 
@@ -13,11 +17,13 @@ template <typename T>
 class basic_radix2_domain : public LagrangeFFT<T>::Base
 {
     typedef typename LagrangeFFT<T>::Base BASE;
+    typedef typename BASE::Coset COSET;
 
 public:
     basic_radix2_domain(const std::size_t min_size)
         : BASE(min_size),
-          omega(BASE::get_root_of_unity(min_size))
+          omega(BASE::get_root_of_unity(min_size)),
+          omega_inverse(inverse(omega))
     {
 #ifdef USE_ASSERT
         assert(min_size > 1);
@@ -46,17 +52,41 @@ public:
     }
 
 protected:
-    void m_FFT(std::vector<T>& a) const {
-        BASE::basic_radix2_FFT(a, omega);
+    void m_FFT(std::vector<T>& a, const COSET* coset, ThreadPool* pool) const {
+        BASE::basic_radix2_FFT(a, omega, pool, coset);
     }
 
-    void m_iFFT(std::vector<T>& a) const {
-        BASE::basic_radix2_FFT(a, inverse(omega));
+    void m_iFFT(std::vector<T>& a, const COSET* coset, ThreadPool* pool) const {
+        BASE::basic_radix2_FFT(a, omega_inverse, pool);
+        BASE::scale(a, inverse(T(a.size())), coset);
+    }
+
+    void m_batchFFT(const std::vector<std::vector<T>*>& a,
+                    const COSET* coset,
+                    ThreadPool* pool) const {
+        BASE::batch_radix2_FFT(pointers(a), BASE::min_size(), omega, pool, coset);
+    }
+
+    void m_batchiFFT(const std::vector<std::vector<T>*>& a,
+                     const COSET* coset,
+                     ThreadPool* pool) const {
+        BASE::batch_radix2_FFT(pointers(a), BASE::min_size(), omega_inverse, pool);
+
+        const T sconst = inverse(T(BASE::min_size()));
+        for (const auto v : a) {
+            BASE::scale(*v, sconst, coset);
+        }
+    }
+
+    static std::vector<T*> pointers(const std::vector<std::vector<T>*>& a) {
+        std::vector<T*> ptrs;
+        ptrs.reserve(a.size());
 
-        const T sconst = inverse(T(a.size()));
-        for (std::size_t i = 0; i < a.size(); ++i) {
-            a[i] *= sconst;
+        for (const auto v : a) {
+            ptrs.push_back(v->data());
         }
+
+        return ptrs;
     }
 
     void m_add_poly_Z(const T& coeff, std::vector<T>& H) const {
@@ -64,8 +94,236 @@ protected:
         H[0] -= coeff;
     }
 
+    T omega, omega_inverse;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// four-step radix-2 evaluation domain
+// Same as the basic domain except for the transform. The vector is a
+// matrix of about sqrt(n) rows and columns. Each row and column transform
+// fits in cache (Bailey's four-step FFT) and uses a twiddle table of its
+// own size. The matrix is transposed in place at the end.
+//
+
+// smallest domain size using the four-step FFT, zero means
+// get_evaluation_domain() never selects it
+#ifndef FOUR_STEP_FFT_MIN_SIZE
+#define FOUR_STEP_FFT_MIN_SIZE (1u << 22)
+#endif
+
+template <typename T>
+class fourstep_radix2_domain : public basic_radix2_domain<T>
+{
+    typedef typename LagrangeFFT<T>::Base BASE;
+    typedef typename BASE::Coset COSET;
+    typedef basic_radix2_domain<T> BASIC;
+
+public:
+    fourstep_radix2_domain(const std::size_t min_size)
+        : BASIC(min_size)
+    {}
+
+protected:
+    void m_FFT(std::vector<T>& a, const COSET* coset, ThreadPool* pool) const {
+        fourstep_FFT(a, BASIC::omega, coset, pool);
+    }
+
+    void m_iFFT(std::vector<T>& a, const COSET* coset, ThreadPool* pool) const {
+        fourstep_FFT(a, BASIC::omega_inverse, nullptr, pool);
+        BASE::scale(a, inverse(T(a.size())), coset);
+    }
+
+    // one vector at a time instead of the batched radix-2 transform
+    void m_batchFFT(const std::vector<std::vector<T>*>& a,
+                    const COSET* coset,
+                    ThreadPool* pool) const {
+        BASE::m_batchFFT(a, coset, pool);
+    }
+
+    void m_batchiFFT(const std::vector<std::vector<T>*>& a,
+                     const COSET* coset,
+                     ThreadPool* pool) const {
+        BASE::m_batchiFFT(a, coset, pool);
+    }
+
 private:
-    T omega;
+    // calls func(startRow, stopRow) for each block of rows
+    template <typename FUNC>
+    static void forRows(const std::size_t numRows,
+                        ThreadPool* pool,
+                        FUNC func)
+    {
+        if (pool) {
+            pool->blockPartition(
+                numRows,
+                [&func] (const std::size_t block,
+                         const std::size_t startRow,
+                         const std::size_t stopRow) {
+                    func(startRow, stopRow);
+                });
+        } else {
+            func(0, numRows);
+        }
+    }
+
+    // in-place transpose of the r x r matrix at a with row length ld
+    static void transpose_square(T* a,
+                                 const std::size_t r,
+                                 const std::size_t ld,
+                                 ThreadPool* pool)
+    {
+        const std::size_t tile = 16;
+
+        forRows(
+            (r + tile - 1) / tile,
+            pool,
+            [a, r, ld, tile] (const std::size_t startTile,
+                              const std::size_t stopTile) {
+                for (std::size_t ti = startTile * tile;
+                     ti < std::min(stopTile * tile, r);
+                     ti += tile)
+                {
+                    const std::size_t iEnd = std::min(ti + tile, r);
+
+                    // tiles on and above the diagonal swap with their mirror
+                    for (std::size_t tj = ti; tj < r; tj += tile) {
+                        const std::size_t jEnd = std::min(tj + tile, r);
+
+                        for (std::size_t i = ti; i < iEnd; ++i) {
+                            for (std::size_t j = std::max(tj, i + 1); j < jEnd; ++j) {
+                                std::swap(a[i * ld + j], a[j * ld + i]);
+                            }
+                        }
+                    }
+                }
+            });
+    }
+
+    // in-place transpose of the rows x cols matrix a where cols is
+    // rows or 2 * rows
+    static void transpose(std::vector<T>& a,
+                          const std::size_t rows,
+                          const std::size_t cols,
+                          ThreadPool* pool)
+    {
+#ifdef USE_ASSERT
+        assert(cols == rows || cols == 2 * rows);
+#endif
+        transpose_square(a.data(), rows, cols, pool);
+        if (cols == rows) return;
+
+        // rows are now [L' R'] with square blocks L' and R' transposed,
+        // the result is all of the L' rows followed by all of the R' rows
+        transpose_square(a.data() + rows, rows, cols, pool);
+
+        // block b moves to b / 2 + (b % 2) * rows, cycle by cycle
+        const std::size_t numBlocks = 2 * rows;
+        std::vector<bool> done(numBlocks, false);
+        std::vector<T> tmp(rows);
+
+        for (std::size_t start = 1; start < numBlocks - 1; ++start) {
+            if (done[start]) continue;
+
+            std::copy(a.begin() + start * rows,
+                      a.begin() + (start + 1) * rows,
+                      tmp.begin());
+
+            std::size_t dst = start;
+
+            while (true) {
+                done[dst] = true;
+
+                // block which moves to dst
+                const std::size_t src = dst < rows
+                    ? 2 * dst
+                    : 2 * (dst - rows) + 1;
+
+                if (src == start) break;
+
+                std::copy(a.begin() + src * rows,
+                          a.begin() + (src + 1) * rows,
+                          a.begin() + dst * rows);
+
+                dst = src;
+            }
+
+            std::copy(tmp.begin(), tmp.end(), a.begin() + dst * rows);
+        }
+    }
+
+    // n = n1 * n2, input a[n2 * j1 + j2] and output A[k1 + n1 * k2]
+    void fourstep_FFT(std::vector<T>& a,
+                      const T& omega,
+                      const COSET* coset,
+                      ThreadPool* pool) const
+    {
+        const std::size_t
+            n = a.size(),
+            n1 = 1u << (ceil_log2(n) / 2),
+            n2 = n / n1,
+            cols = std::min<std::size_t>(8, n2);
+
+        // twiddle tables of the two sub-transform sizes and w^j2
+        const auto
+            twiddle1 = PowersCache<T>::powers(omega ^ n2, n1 / 2),
+            twiddle2 = PowersCache<T>::powers(omega ^ n1, n2 / 2),
+            omegaPowers = PowersCache<T>::powers(omega, n2);
+
+        const T
+            *tw1 = twiddle1->data(),
+            *tw2 = twiddle2->data(),
+            *wj2 = omegaPowers->data();
+
+        // length n1 columns, a few at a time in a contiguous buffer
+        forRows(
+            n2 / cols,
+            pool,
+            [&a, coset, tw1, wj2, n1, n2, cols] (const std::size_t startBlock,
+                                                 const std::size_t stopBlock) {
+                std::vector<T> buf(cols * n1);
+
+                for (std::size_t j0 = startBlock * cols; j0 < stopBlock * cols; j0 += cols) {
+                    for (std::size_t j1 = 0; j1 < n1; ++j1) {
+                        for (std::size_t c = 0; c < cols; ++c) {
+                            buf[c * n1 + j1] = BASE::coset_times(a, n2 * j1 + j0 + c, coset);
+                        }
+                    }
+
+                    for (std::size_t c = 0; c < cols; ++c) {
+                        T* col = buf.data() + c * n1;
+                        BASE::radix2_FFT(col, n1, tw1, 1);
+
+                        // multiply by w^(j2 * k1)
+                        const T& w = wj2[j0 + c];
+                        T u = w;
+
+                        for (std::size_t k1 = 1; k1 < n1; ++k1) {
+                            col[k1] *= u;
+                            u *= w;
+                        }
+                    }
+
+                    for (std::size_t j1 = 0; j1 < n1; ++j1) {
+                        for (std::size_t c = 0; c < cols; ++c) {
+                            a[n2 * j1 + j0 + c] = buf[c * n1 + j1];
+                        }
+                    }
+                }
+            });
+
+        // length n2 rows in place
+        forRows(
+            n1,
+            pool,
+            [&a, tw2, n2] (const std::size_t startRow,
+                           const std::size_t stopRow) {
+                for (std::size_t k1 = startRow; k1 < stopRow; ++k1) {
+                    BASE::radix2_FFT(a.data() + k1 * n2, n2, tw2, 1);
+                }
+            });
+
+        transpose(a, n1, n2, pool);
+    }
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -76,12 +334,14 @@ template <typename T>
 class extended_radix2_domain : public LagrangeFFT<T>::Base
 {
     typedef typename LagrangeFFT<T>::Base BASE;
+    typedef typename BASE::Coset COSET;
 
 public:
     extended_radix2_domain(const std::size_t min_size)
         : BASE(min_size),
           small_m(min_size / 2),
           omega(BASE::get_root_of_unity(small_m)),
+          omega_inverse(inverse(omega)),
           shift(BASE::coset_shift())
     {
 #ifdef USE_ASSERT
@@ -149,7 +409,7 @@ public:
     }
 
 protected:
-    void m_FFT(std::vector<T>& a) const {
+    void m_FFT(std::vector<T>& a, const COSET* coset, ThreadPool* pool) const {
         std::vector<T>
             a0(small_m, T::zero()),
             a1(small_m, T::zero());
@@ -158,14 +418,18 @@ protected:
 
         T shift_i = T::one();
         for (std::size_t i = 0; i < small_m; ++i) {
-            a0[i] = a[i] + a[small_m + i];
-            a1[i] = shift_i * (a[i] + shift_to_small_m * a[small_m + i]);
+            const T
+                x = BASE::coset_times(a, i, coset),
+                y = BASE::coset_times(a, small_m + i, coset);
+
+            a0[i] = x + y;
+            a1[i] = shift_i * (x + shift_to_small_m * y);
 
             shift_i *= shift;
         }
 
-        BASE::basic_radix2_FFT(a0, omega);
-        BASE::basic_radix2_FFT(a1, omega);
+        BASE::basic_radix2_FFT(a0, omega, pool);
+        BASE::basic_radix2_FFT(a1, omega, pool);
 
         for (std::size_t i = 0; i < small_m; ++i) {
             a[i] = a0[i];
@@ -173,14 +437,13 @@ protected:
         }
     }
 
-    void m_iFFT(std::vector<T>& a) const {
+    void m_iFFT(std::vector<T>& a, const COSET* coset, ThreadPool* pool) const {
         std::vector<T>
             a0(a.begin(), a.begin() + small_m),
             a1(a.begin() + small_m, a.end());
 
-        const T omega_inverse = inverse(omega);
-        BASE::basic_radix2_FFT(a0, omega_inverse);
-        BASE::basic_radix2_FFT(a1, omega_inverse);
+        BASE::basic_radix2_FFT(a0, omega_inverse, pool);
+        BASE::basic_radix2_FFT(a1, omega_inverse, pool);
 
         const T shift_to_small_m = shift ^ small_m;
         const T sconst = inverse(T(small_m) * (T::one() - shift_to_small_m));
@@ -192,6 +455,11 @@ protected:
             a[i] = sconst * (-shift_to_small_m * a0[i] + shift_inverse_i * a1[i]);
             a[i + small_m] = sconst * (a0[i] - shift_inverse_i * a1[i]);
 
+            if (coset) {
+                a[i] *= (*coset)[i];
+                a[i + small_m] *= (*coset)[i + small_m];
+            }
+
             shift_inverse_i *= shift_inverse;
         }
     }
@@ -206,7 +474,7 @@ protected:
 
 private:
     std::size_t small_m;
-    T omega, shift;
+    T omega, omega_inverse, shift;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -217,6 +485,7 @@ template <typename T>
 class step_radix2_domain : public LagrangeFFT<T>::Base
 {
     typedef typename LagrangeFFT<T>::Base BASE;
+    typedef typename BASE::Coset COSET;
 
 public:
     step_radix2_domain(const std::size_t min_size)
@@ -225,7 +494,9 @@ public:
           small_m(min_size - big_m),
           omega(BASE::get_root_of_unity(1u << ceil_log2(min_size))),
           big_omega(squared(omega)),
-          small_omega(BASE::get_root_of_unity(small_m))
+          small_omega(BASE::get_root_of_unity(small_m)),
+          big_omega_inverse(inverse(big_omega)),
+          small_omega_inverse(inverse(small_omega))
     {
 #ifdef USE_ASSERT
         assert(min_size > 1);
@@ -238,7 +509,8 @@ public:
             inner_big = BASE::basic_radix2_lagrange_coeffs(big_m, t),
             inner_small = BASE::basic_radix2_lagrange_coeffs(small_m, t * inverse(omega));
 
-        std::vector<T> result(BASE::min_size(), T::zero());
+        std::vector<T> result;
+        result.reserve(BASE::min_size());
 
         const T
             L0 = (t ^ small_m) - (omega ^ small_m),
@@ -247,10 +519,18 @@ public:
 
         T elt = T::one();
         for (std::size_t i = 0; i < big_m; ++i) {
-            result[i] = inner_big[i] * L0 * inverse(elt - omega_to_small_m);
+            result.push_back(elt - omega_to_small_m);
             elt *= big_omega_to_small_m;
         }
 
+        batch_invert(result);
+
+        for (std::size_t i = 0; i < big_m; ++i) {
+            result[i] *= inner_big[i] * L0;
+        }
+
+        result.resize(BASE::min_size(), T::zero());
+
         const T L1 = ((t ^ big_m) - T::one()) * inverse((omega ^ big_m) - T::one());
 
         for (std::size_t i = 0; i < small_m; ++i) {
@@ -296,19 +576,23 @@ public:
     }
 
 protected:
-    void m_FFT(std::vector<T>& a) const {
+    void m_FFT(std::vector<T>& a, const COSET* coset, ThreadPool* pool) const {
         std::vector<T>
             c(big_m, T::zero()),
             d(big_m, T::zero());
 
         T omega_i = T::one();
         for (std::size_t i = 0; i < big_m; ++i) {
+            const T x = BASE::coset_times(a, i, coset);
+
             if (i < small_m) {
-                c[i] = a[i] + a[i + big_m];
-                d[i] = omega_i * (a[i] - a[i + big_m]);
+                const T y = BASE::coset_times(a, i + big_m, coset);
+
+                c[i] = x + y;
+                d[i] = omega_i * (x - y);
             } else {
-                c[i] = a[i];
-                d[i] = omega_i * a[i];
+                c[i] = x;
+                d[i] = omega_i * x;
             }
 
             omega_i *= omega;
@@ -322,8 +606,8 @@ protected:
                 e[i] += d[i + j * small_m];
         }
 
-        BASE::basic_radix2_FFT(c, squared(omega));
-        BASE::basic_radix2_FFT(e, BASE::get_root_of_unity(small_m));
+        BASE::basic_radix2_FFT(c, big_omega, pool);
+        BASE::basic_radix2_FFT(e, small_omega, pool);
 
         for (std::size_t i = 0; i < big_m; ++i) {
             a[i] = c[i];
@@ -334,13 +618,13 @@ protected:
         }
     }
 
-    void m_iFFT(std::vector<T>& a) const {
+    void m_iFFT(std::vector<T>& a, const COSET* coset, ThreadPool* pool) const {
         std::vector<T>
             U0(a.begin(), a.begin() + big_m),
             U1(a.begin() + big_m, a.end());
 
-        BASE::basic_radix2_FFT(U0, inverse(squared(omega)));
-        BASE::basic_radix2_FFT(U1, inverse(BASE::get_root_of_unity(small_m)));
+        BASE::basic_radix2_FFT(U0, big_omega_inverse, pool);
+        BASE::basic_radix2_FFT(U1, small_omega_inverse, pool);
 
         const T U0_size_inv = inverse(T(big_m));
         for (std::size_t i = 0; i < big_m; ++i) {
@@ -360,7 +644,7 @@ protected:
         }
 
         for (std::size_t i = small_m; i < big_m; ++i) {
-            a[i] = U0[i];
+            a[i] = BASE::coset_times(U0, i, coset);
         }
 
         const std::size_t compr = 1u << (ceil_log2(big_m) - ceil_log2(small_m));
@@ -381,6 +665,11 @@ protected:
         for (std::size_t i = 0; i < small_m; ++i) {
             a[i] = (U0[i] + U1[i]) * over_two;
             a[big_m + i] = (U0[i] - U1[i]) * over_two;
+
+            if (coset) {
+                a[i] *= (*coset)[i];
+                a[big_m + i] *= (*coset)[big_m + i];
+            }
         }
     }
 
@@ -395,7 +684,7 @@ protected:
 
 private:
     std::size_t big_m, small_m;
-    T omega, big_omega, small_omega;
+    T omega, big_omega, small_omega, big_omega_inverse, small_omega_inverse;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -417,6 +706,8 @@ void* get_evaluation_domain(const std::size_t min_size) {
     if (min_size == (1u << log_min_size)) {
         if (log_min_size == T::params.s() + 1) {
             ptr = new extended_radix2_domain<T>(min_size);
+        } else if (FOUR_STEP_FFT_MIN_SIZE && min_size >= FOUR_STEP_FFT_MIN_SIZE) {
+            ptr = new fourstep_radix2_domain<T>(min_size);
         } else {
             ptr = new basic_radix2_domain<T>(min_size);
         }
@@ -427,7 +718,12 @@ void* get_evaluation_domain(const std::size_t min_size) {
 
         if (big == rounded_small) {
             if (ceil_log2(big + rounded_small) < T::params.s() + 1) {
-                ptr = new basic_radix2_domain<T>(big + rounded_small);
+                if (FOUR_STEP_FFT_MIN_SIZE &&
+                    big + rounded_small >= FOUR_STEP_FFT_MIN_SIZE) {
+                    ptr = new fourstep_radix2_domain<T>(big + rounded_small);
+                } else {
+                    ptr = new basic_radix2_domain<T>(big + rounded_small);
+                }
             } else {
                 ptr = new extended_radix2_domain<T>(big + rounded_small);
             }
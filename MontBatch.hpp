@@ -0,0 +1,202 @@
+#ifndef _SNARKLIB_MONT_BATCH_HPP_
+#define _SNARKLIB_MONT_BATCH_HPP_
+
+#include <cstdint>
+#include <gmp.h>
+
+#if defined(__x86_64__) && defined(USE_ASM) && defined(__GNUC__) && (64 == GMP_NUMB_BITS)
+#define SNARKLIB_MONT_BATCH
+#include <immintrin.h>
+
+// limb loops must be unrolled so registers replace the arrays
+#if defined(__clang__)
+#define SNARKLIB_UNROLL _Pragma("unroll")
+#elif __GNUC__ >= 8
+#define SNARKLIB_UNROLL _Pragma("GCC unroll 16")
+#else
+#define SNARKLIB_UNROLL
+#endif
+#endif
+
+namespace snarklib {
+
+////////////////////////////////////////////////////////////////////////////////
+// Montgomery multiplication of eight elements at once (AVX-512 IFMA)
+//
+// Each 64-bit lane of a ZMM register holds one 52-bit limb of a
+// different element, so the VPMADD52LUQ/VPMADD52HUQ instructions
+// multiply and accumulate eight limb products in parallel. Limbs are
+// accumulated without carries, only the Montgomery quotient digit is
+// computed exactly.
+//
+// Elements are N limbs of 64 bits in Montgomery form with R = 2^(64N).
+// Radix 2^52 needs L = ceil(64N / 52) limbs and its reduction divides
+// by 2^(52L), which is 2^SHIFT times too much. The first multiplicand
+// is shifted up by SHIFT bits while converting to make up for that.
+// The result is fully reduced and identical to mulReduce().
+//
+// The kernel is compiled for AVX-512 with a function attribute, the
+// caller must check CpuFeatures::avx512ifma() before using it.
+//
+
+#ifdef SNARKLIB_MONT_BATCH
+
+template <mp_size_t N>
+class MontBatch
+{
+public:
+    // number of elements in each call
+    static const std::size_t LANES = 8;
+
+    // r[k] = a[k] * b[k] / R mod m (r[k] may be a[k] or b[k])
+    static void mul(mp_limb_t* const r[LANES],
+                    const mp_limb_t* const a[LANES],
+                    const mp_limb_t* const b[LANES],
+                    const mp_limb_t* m,
+                    const mp_limb_t inv)
+    {
+        alignas(64) std::uint64_t x[L * LANES], y[L * LANES];
+        std::uint64_t m52[L];
+
+        SNARKLIB_UNROLL
+        for (std::size_t k = 0; k < LANES; ++k) {
+            toRadix52(x + k, a[k], SHIFT);
+            toRadix52(y + k, b[k], 0);
+        }
+
+        SNARKLIB_UNROLL
+        for (std::size_t j = 0; j < L; ++j)
+            m52[j] = limb52(m, 52 * j);
+
+        mulLanes(x, y, m52, inv & MASK);
+
+        SNARKLIB_UNROLL
+        for (std::size_t k = 0; k < LANES; ++k)
+            fromRadix52(r[k], x + k);
+    }
+
+private:
+    static const std::size_t
+        L = (64 * N + 51) / 52,
+        SHIFT = 52 * L - 64 * N;
+
+    static const std::uint64_t MASK = (std::uint64_t(1) << 52) - 1;
+
+    // 52 bits of a starting at bit pos (which may be negative)
+    static std::uint64_t limb52(const mp_limb_t* a, const long pos) {
+        if (pos < 0) return (a[0] << -pos) & MASK;
+
+        const std::size_t j = pos / 64, s = pos % 64;
+        std::uint64_t v = a[j] >> s;
+        if (s && j + 1 < N) v |= a[j + 1] << (64 - s);
+
+        return v & MASK;
+    }
+
+    // x[LANES * j] = limb j of a * 2^shift in radix 2^52
+    static void toRadix52(std::uint64_t* x,
+                          const mp_limb_t* a,
+                          const std::size_t shift)
+    {
+        SNARKLIB_UNROLL
+        for (std::size_t j = 0; j < L; ++j)
+            x[LANES * j] = limb52(a, long(52 * j) - long(shift));
+    }
+
+    // r = x where x[LANES * j] is limb j in radix 2^52
+    static void fromRadix52(mp_limb_t* r, const std::uint64_t* x) {
+        SNARKLIB_UNROLL
+        for (std::size_t i = 0; i < N; ++i) {
+            const std::size_t k = 64 * i / 52, s = 64 * i % 52;
+            mp_limb_t v = x[LANES * k] >> s;
+            if (k + 1 < L) v |= x[LANES * (k + 1)] << (52 - s);
+            if (k + 2 < L && s > 40) v |= x[LANES * (k + 2)] << (104 - s);
+            r[i] = v;
+        }
+    }
+
+    // x = x * y / 2^(52L) mod m, fully reduced, eight lanes
+    __attribute__((target("avx512f,avx512ifma")))
+    static void mulLanes(std::uint64_t* x,
+                         const std::uint64_t* y,
+                         const std::uint64_t* m52,
+                         const std::uint64_t inv52)
+    {
+        const __m512i
+            zero = _mm512_setzero_si512(),
+            mask = _mm512_set1_epi64(MASK),
+            minv = _mm512_set1_epi64(inv52);
+
+        __m512i A[L], M[L], T[L + 1];
+
+        SNARKLIB_UNROLL
+        for (std::size_t j = 0; j < L; ++j) {
+            A[j] = _mm512_load_si512(x + LANES * j);
+            M[j] = _mm512_set1_epi64(m52[j]);
+            T[j] = zero;
+        }
+
+        T[L] = zero;
+
+        SNARKLIB_UNROLL
+        for (std::size_t i = 0; i < L; ++i) {
+            // T = T + A * y[i]
+            const __m512i bi = _mm512_load_si512(y + LANES * i);
+
+            SNARKLIB_UNROLL
+            for (std::size_t j = 0; j < L; ++j) {
+                T[j] = _mm512_madd52lo_epu64(T[j], A[j], bi);
+                T[j + 1] = _mm512_madd52hi_epu64(T[j + 1], A[j], bi);
+            }
+
+            // T = (T + u * M) / 2^52
+            const __m512i u = _mm512_madd52lo_epu64(zero, T[0], minv);
+
+            SNARKLIB_UNROLL
+            for (std::size_t j = 0; j < L; ++j) {
+                T[j] = _mm512_madd52lo_epu64(T[j], M[j], u);
+                T[j + 1] = _mm512_madd52hi_epu64(T[j + 1], M[j], u);
+            }
+
+            T[1] = _mm512_add_epi64(T[1], _mm512_srli_epi64(T[0], 52));
+
+            SNARKLIB_UNROLL
+            for (std::size_t j = 0; j < L; ++j)
+                T[j] = T[j + 1];
+
+            T[L] = zero;
+        }
+
+        // propagate carries, T < 2m
+        SNARKLIB_UNROLL
+        for (std::size_t j = 0; j + 1 < L; ++j) {
+            T[j + 1] = _mm512_add_epi64(T[j + 1], _mm512_srli_epi64(T[j], 52));
+            T[j] = _mm512_and_si512(T[j], mask);
+        }
+
+        // subtract m unless that borrows
+        __m512i D[L], borrow = zero;
+
+        SNARKLIB_UNROLL
+        for (std::size_t j = 0; j < L; ++j) {
+            const __m512i d =
+                _mm512_sub_epi64(_mm512_sub_epi64(T[j], M[j]), borrow);
+
+            borrow = _mm512_srli_epi64(d, 63);
+            D[j] = _mm512_and_si512(d, mask);
+        }
+
+        const __mmask8 keep = _mm512_test_epi64_mask(borrow, borrow);
+
+        SNARKLIB_UNROLL
+        for (std::size_t j = 0; j < L; ++j)
+            _mm512_store_si512(x + LANES * j,
+                               _mm512_mask_blend_epi64(keep, D[j], T[j]));
+    }
+};
+
+#endif
+
+} // namespace snarklib
+
+#endif
@@ -0,0 +1,572 @@
+#ifndef _SNARKLIB_MONT_KERNEL_HPP_
+#define _SNARKLIB_MONT_KERNEL_HPP_
+
+#include <cstdint>
+#include <gmp.h>
+#include <type_traits>
+
+namespace snarklib {
+
+////////////////////////////////////////////////////////////////////////////////
+// Montgomery arithmetic on fixed size limb arrays
+//
+// Portable C++ replacement for the GMP mpn_* calls in FpModel. Limb
+// products use unsigned __int128. Loops over limbs are unrolled by
+// template recursion so every N is straight-line code the compiler
+// can inline, including limb counts without assembler.
+//
+// Inputs are less than the modulus (except the first multiplicand,
+// which may be any N limb number) and results are fully reduced, so
+// the values are identical to the GMP and assembler versions.
+//
+
+#if defined(__SIZEOF_INT128__) && (64 == GMP_NUMB_BITS)
+#define SNARKLIB_MONT_KERNEL
+#endif
+
+#ifdef SNARKLIB_MONT_KERNEL
+
+typedef unsigned __int128 mp_dlimb_t;
+
+// limb I of a loop over N limbs
+template <mp_size_t I, mp_size_t N>
+struct MontLimb
+{
+    // r = a + b + carry
+    static void add(mp_limb_t* r,
+                    const mp_limb_t* a,
+                    const mp_limb_t* b,
+                    const mp_limb_t carry,
+                    mp_limb_t& carryOut)
+    {
+        const mp_dlimb_t s = mp_dlimb_t(a[I]) + b[I] + carry;
+        r[I] = mp_limb_t(s);
+        MontLimb<I + 1, N>::add(r, a, b, mp_limb_t(s >> 64), carryOut);
+    }
+
+    // r = a - b - borrow
+    static void sub(mp_limb_t* r,
+                    const mp_limb_t* a,
+                    const mp_limb_t* b,
+                    const mp_limb_t borrow,
+                    mp_limb_t& borrowOut)
+    {
+        const mp_dlimb_t d = mp_dlimb_t(a[I]) - b[I] - borrow;
+        r[I] = mp_limb_t(d);
+        MontLimb<I + 1, N>::sub(r, a, b, mp_limb_t(d >> 64) & 1, borrowOut);
+    }
+
+    // r = r + (m & mask) + carry
+    static void addMask(mp_limb_t* r,
+                        const mp_limb_t* m,
+                        const mp_limb_t mask,
+                        const mp_limb_t carry)
+    {
+        const mp_dlimb_t s = mp_dlimb_t(r[I]) + (m[I] & mask) + carry;
+        r[I] = mp_limb_t(s);
+        MontLimb<I + 1, N>::addMask(r, m, mask, mp_limb_t(s >> 64));
+    }
+
+    // r = mask ? a : b
+    static void select(mp_limb_t* r,
+                       const mp_limb_t* a,
+                       const mp_limb_t* b,
+                       const mp_limb_t mask)
+    {
+        r[I] = (a[I] & mask) | (b[I] & ~mask);
+        MontLimb<I + 1, N>::select(r, a, b, mask);
+    }
+
+    // t = t + a * b + C, returns carry
+    static mp_limb_t mulAdd(mp_limb_t* t,
+                            const mp_limb_t* a,
+                            const mp_limb_t b,
+                            const mp_limb_t C)
+    {
+        const mp_dlimb_t s = mp_dlimb_t(a[I]) * b + t[I] + C;
+        t[I] = mp_limb_t(s);
+        return MontLimb<I + 1, N>::mulAdd(t, a, b, mp_limb_t(s >> 64));
+    }
+
+    // t[I - 1] = t[I] + u * m[I] + C, returns carry
+    static mp_limb_t mulShift(mp_limb_t* t,
+                              const mp_limb_t* m,
+                              const mp_limb_t u,
+                              const mp_limb_t C)
+    {
+        const mp_dlimb_t s = mp_dlimb_t(u) * m[I] + t[I] + C;
+        t[I - 1] = mp_limb_t(s);
+        return MontLimb<I + 1, N>::mulShift(t, m, u, mp_limb_t(s >> 64));
+    }
+
+    // CIOS outer iteration for limb b[I], t has N + 2 limbs
+    static void cios(mp_limb_t* t,
+                     const mp_limb_t* a,
+                     const mp_limb_t* b,
+                     const mp_limb_t* m,
+                     const mp_limb_t inv)
+    {
+        // t = t + a * b[I]
+        mp_limb_t C = MontLimb<0, N>::mulAdd(t, a, b[I], 0);
+        const mp_dlimb_t s = mp_dlimb_t(t[N]) + C;
+        t[N] = mp_limb_t(s);
+        t[N + 1] = mp_limb_t(s >> 64);
+
+        // t = (t + u * m) / 2^64
+        const mp_limb_t u = t[0] * inv;
+        C = mp_limb_t((mp_dlimb_t(u) * m[0] + t[0]) >> 64);
+        C = MontLimb<1, N>::mulShift(t, m, u, C);
+
+        const mp_dlimb_t c = mp_dlimb_t(t[N]) + C;
+        t[N - 1] = mp_limb_t(c);
+        t[N] = t[N + 1] + mp_limb_t(c >> 64);
+
+        MontLimb<I + 1, N>::cios(t, a, b, m, inv);
+    }
+
+    // schoolbook row for limb b[I], t has 2N limbs
+    static void mulWide(mp_limb_t* t,
+                        const mp_limb_t* a,
+                        const mp_limb_t* b)
+    {
+        t[N + I] = MontLimb<0, N>::mulAdd(t + I, a, b[I], 0);
+        MontLimb<I + 1, N>::mulWide(t, a, b);
+    }
+
+    // REDC iteration adding limb w[I] of the high half, t has N + 1 limbs
+    static void redc(mp_limb_t* t,
+                     const mp_limb_t* w,
+                     const mp_limb_t* m,
+                     const mp_limb_t inv)
+    {
+        // t = (t + u * m) / 2^64
+        const mp_limb_t u = t[0] * inv;
+        mp_limb_t C = mp_limb_t((mp_dlimb_t(u) * m[0] + t[0]) >> 64);
+        C = MontLimb<1, N>::mulShift(t, m, u, C);
+
+        const mp_dlimb_t c = mp_dlimb_t(t[N]) + w[I] + C;
+        t[N - 1] = mp_limb_t(c);
+        t[N] = mp_limb_t(c >> 64);
+
+        MontLimb<I + 1, N>::redc(t, w, m, inv);
+    }
+};
+
+// end of recursion
+template <mp_size_t N>
+struct MontLimb<N, N>
+{
+    static void add(mp_limb_t*,
+                    const mp_limb_t*,
+                    const mp_limb_t*,
+                    const mp_limb_t carry,
+                    mp_limb_t& carryOut)
+    {
+        carryOut = carry;
+    }
+
+    static void sub(mp_limb_t*,
+                    const mp_limb_t*,
+                    const mp_limb_t*,
+                    const mp_limb_t borrow,
+                    mp_limb_t& borrowOut)
+    {
+        borrowOut = borrow;
+    }
+
+    static void addMask(mp_limb_t*,
+                        const mp_limb_t*,
+                        const mp_limb_t,
+                        const mp_limb_t)
+    {}
+
+    static void select(mp_limb_t*,
+                       const mp_limb_t*,
+                       const mp_limb_t*,
+                       const mp_limb_t)
+    {}
+
+    static mp_limb_t mulAdd(mp_limb_t*,
+                            const mp_limb_t*,
+                            const mp_limb_t,
+                            const mp_limb_t C)
+    {
+        return C;
+    }
+
+    static mp_limb_t mulShift(mp_limb_t*,
+                              const mp_limb_t*,
+                              const mp_limb_t,
+                              const mp_limb_t C)
+    {
+        return C;
+    }
+
+    static void cios(mp_limb_t*,
+                     const mp_limb_t*,
+                     const mp_limb_t*,
+                     const mp_limb_t*,
+                     const mp_limb_t)
+    {}
+
+    static void mulWide(mp_limb_t*,
+                        const mp_limb_t*,
+                        const mp_limb_t*)
+    {}
+
+    static void redc(mp_limb_t*,
+                     const mp_limb_t*,
+                     const mp_limb_t*,
+                     const mp_limb_t)
+    {}
+};
+
+template <mp_size_t N>
+class MontKernel
+{
+    typedef MontLimb<0, N> LIMBS;
+
+public:
+    // r = a + b mod m
+    static void add(mp_limb_t* r,
+                    const mp_limb_t* a,
+                    const mp_limb_t* b,
+                    const mp_limb_t* m)
+    {
+        mp_limb_t t[N], carry;
+        LIMBS::add(t, a, b, 0, carry);
+        reduce(r, t, carry, m);
+    }
+
+    // r = a - b mod m
+    static void sub(mp_limb_t* r,
+                    const mp_limb_t* a,
+                    const mp_limb_t* b,
+                    const mp_limb_t* m)
+    {
+        mp_limb_t borrow;
+        LIMBS::sub(r, a, b, 0, borrow);
+
+        // add modulus back if negative
+        LIMBS::addMask(r, m, -borrow, 0);
+    }
+
+    // r = a * b / R mod m (CIOS method)
+    static void mul(mp_limb_t* r,
+                    const mp_limb_t* a,
+                    const mp_limb_t* b,
+                    const mp_limb_t* m,
+                    const mp_limb_t inv)
+    {
+        mp_limb_t t[N + 2] = {};
+        LIMBS::cios(t, a, b, m, inv);
+        reduce(r, t, t[N], m);
+    }
+
+    // r = m - a, a is not zero
+    static void neg(mp_limb_t* r,
+                    const mp_limb_t* a,
+                    const mp_limb_t* m)
+    {
+        mp_limb_t borrow;
+        LIMBS::sub(r, m, a, 0, borrow);
+    }
+
+    // r = t - m if (carry, t) >= m, otherwise r = t
+    static void reduce(mp_limb_t* r,
+                       const mp_limb_t* t,
+                       const mp_limb_t carry,
+                       const mp_limb_t* m)
+    {
+        mp_limb_t d[N], borrow;
+        LIMBS::sub(d, t, m, 0, borrow);
+
+        // keep t only if no carry out and t < m
+        LIMBS::select(r, t, d, -(borrow & (carry ^ 1)));
+    }
+
+    // double width values for lazy reduction have 2N limbs and are
+    // kept less than m * R, so any sum or difference of products can
+    // be reduced once at the end
+
+    // t = a * b, no reduction
+    static void mulWide(mp_limb_t* t,
+                        const mp_limb_t* a,
+                        const mp_limb_t* b)
+    {
+        for (mp_size_t i = 0; i < N; ++i) t[i] = 0;
+        LIMBS::mulWide(t, a, b);
+    }
+
+    // r = a + b mod m * R
+    static void addWide(mp_limb_t* r,
+                        const mp_limb_t* a,
+                        const mp_limb_t* b,
+                        const mp_limb_t* m)
+    {
+        mp_limb_t carry;
+        MontLimb<0, 2 * N>::add(r, a, b, 0, carry);
+        reduce(r + N, r + N, carry, m);
+    }
+
+    // r = a - b mod m * R
+    static void subWide(mp_limb_t* r,
+                        const mp_limb_t* a,
+                        const mp_limb_t* b,
+                        const mp_limb_t* m)
+    {
+        mp_limb_t borrow;
+        MontLimb<0, 2 * N>::sub(r, a, b, 0, borrow);
+
+        // add m * R back if negative
+        LIMBS::addMask(r + N, m, -borrow, 0);
+    }
+
+    // r = t / R mod m for t < m * R
+    static void reduceWide(mp_limb_t* r,
+                           const mp_limb_t* t,
+                           const mp_limb_t* m,
+                           const mp_limb_t inv)
+    {
+        mp_limb_t s[N + 1];
+        for (mp_size_t i = 0; i < N; ++i) s[i] = t[i];
+        s[N] = 0;
+
+        LIMBS::redc(s, t + N, m, inv);
+        reduce(r, s, s[N], m);
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Constant-time modular inversion (Bernstein-Yang safegcd)
+//
+// Half-delta divsteps are applied 62 at a time to the low limbs of f
+// and g. This gives a 2x2 transition matrix scaled by 2^62, which is
+// then applied to the full numbers f, g and to d, e (kept modulo m).
+// Numbers are signed with 62-bit limbs and a signed top limb.
+//
+// The number of divsteps is fixed, so the running time does not depend
+// on the values. 590 half-delta divsteps are enough for 256 bit inputs
+// (computed by Wuille for libsecp256k1). There is no such bound here for
+// larger inputs, so the class is only defined for N <= 4 (the bound in
+// the paper is for the original divsteps, not half-delta).
+//
+// mpn_gcdext() is variable-time but faster (BN128 Fq 2.8 vs 3.7 us,
+// Edwards Fq 1.9 vs 3.5 us). FpModel::invert() uses this only when
+// USE_SAFEGCD is defined and the modulus is not too large.
+//
+
+typedef __int128 mp_sdlimb_t;
+
+template <mp_size_t N>
+struct HasMontInverse : std::integral_constant<bool, 64 * N <= 256>
+{};
+
+template <mp_size_t N>
+class MontInverse
+{
+    static_assert(HasMontInverse<N>::value,
+                  "no half-delta divstep bound for more than 256 bits");
+
+public:
+    // r = c / a mod m, a is not zero, a and c are less than m
+    static void invert(mp_limb_t* r,
+                       const mp_limb_t* a,
+                       const mp_limb_t* c,
+                       const mp_limb_t* m,
+                       const mp_limb_t inv)
+    {
+        std::int64_t p[L], f[L], g[L], d[L] = {}, e[L];
+        toSigned62(p, m);
+        toSigned62(f, m);
+        toSigned62(g, a);
+        toSigned62(e, c);
+
+        // m^-1 mod 2^62 (inv is -m^-1 mod 2^64)
+        const std::uint64_t minv = -inv & MASK;
+
+        std::int64_t zeta = -1; // delta = 1/2
+        Matrix t;
+
+        for (std::size_t i = 0; i < BATCHES; ++i) {
+            zeta = divsteps(zeta, f[0], g[0], t);
+            updateDE(d, e, t, p, minv);
+            updateFG(f, g, t);
+        }
+
+        // g is zero and f is 1 or -1, so d * a = c * f
+        normalize(d, f[L - 1] >> 63, p);
+        fromSigned62(r, d);
+    }
+
+private:
+    static const std::size_t
+        L = (64 * N + 2 + 61) / 62,
+        STEPS = 590,
+        BATCHES = (STEPS + 61) / 62;
+
+    static const std::int64_t MASK = (std::int64_t(1) << 62) - 1;
+
+    // [f g] = [u v; q r] [f g] / 2^62
+    struct Matrix { std::int64_t u, v, q, r; };
+
+    static void toSigned62(std::int64_t* x, const mp_limb_t* a) {
+        for (std::size_t j = 0; j < L; ++j) {
+            const std::size_t k = 62 * j / 64, s = 62 * j % 64;
+            std::uint64_t v = k < N ? a[k] >> s : 0;
+            if (s > 2 && k + 1 < N) v |= a[k + 1] << (64 - s);
+            x[j] = v & MASK;
+        }
+    }
+
+    // x is in [0, m)
+    static void fromSigned62(mp_limb_t* r, const std::int64_t* x) {
+        for (std::size_t i = 0; i < N; ++i) {
+            const std::size_t k = 64 * i / 62, s = 64 * i % 62;
+            std::uint64_t v = std::uint64_t(x[k]) >> s;
+            if (k + 1 < L) v |= std::uint64_t(x[k + 1]) << (62 - s);
+            if (k + 2 < L && s > 60) v |= std::uint64_t(x[k + 2]) << (124 - s);
+            r[i] = v;
+        }
+    }
+
+    // 62 half-delta divsteps on the low bits of f and g,
+    // returns zeta = -(delta + 1/2), matrix entries are at most 2^62
+    static std::int64_t divsteps(std::int64_t zeta,
+                                 std::uint64_t f,
+                                 std::uint64_t g,
+                                 Matrix& t)
+    {
+        std::uint64_t u = 1, v = 0, q = 0, r = 1;
+
+        for (std::size_t i = 0; i < 62; ++i) {
+            // all ones if delta > 0, all ones if g is odd
+            const std::uint64_t c1 = zeta >> 63, c2 = -(g & 1);
+
+            // g = g - f if delta > 0, otherwise g + f (only if g is odd)
+            g += ((f ^ c1) - c1) & c2;
+            q += ((u ^ c1) - c1) & c2;
+            r += ((v ^ c1) - c1) & c2;
+
+            // if both, f = old g and delta = 1 - delta,
+            // otherwise delta = delta + 1
+            const std::uint64_t c3 = c1 & c2;
+            f += g & c3;
+            u += q & c3;
+            v += r & c3;
+            zeta = (zeta ^ c3) - 1;
+
+            g >>= 1;
+            u <<= 1;
+            v <<= 1;
+        }
+
+        t.u = u;
+        t.v = v;
+        t.q = q;
+        t.r = r;
+
+        return zeta;
+    }
+
+    // [d e] = [u v; q r] [d e] / 2^62 mod m, stays in (-2m, m)
+    static void updateDE(std::int64_t* d,
+                         std::int64_t* e,
+                         const Matrix& t,
+                         const std::int64_t* p,
+                         const std::uint64_t minv)
+    {
+        // add multiples of m so the result is not too negative
+        const std::int64_t sd = d[L - 1] >> 63, se = e[L - 1] >> 63;
+        std::int64_t
+            md = (t.u & sd) + (t.v & se),
+            me = (t.q & sd) + (t.r & se);
+
+        mp_sdlimb_t
+            cd = mp_sdlimb_t(t.u) * d[0] + mp_sdlimb_t(t.v) * e[0],
+            ce = mp_sdlimb_t(t.q) * d[0] + mp_sdlimb_t(t.r) * e[0];
+
+        // and so the low 62 bits are zero
+        md -= (minv * std::uint64_t(cd) + md) & MASK;
+        me -= (minv * std::uint64_t(ce) + me) & MASK;
+
+        cd += mp_sdlimb_t(p[0]) * md;
+        ce += mp_sdlimb_t(p[0]) * me;
+        cd >>= 62;
+        ce >>= 62;
+
+        for (std::size_t i = 1; i < L; ++i) {
+            cd += mp_sdlimb_t(t.u) * d[i] + mp_sdlimb_t(t.v) * e[i]
+                + mp_sdlimb_t(p[i]) * md;
+            ce += mp_sdlimb_t(t.q) * d[i] + mp_sdlimb_t(t.r) * e[i]
+                + mp_sdlimb_t(p[i]) * me;
+
+            d[i - 1] = std::int64_t(cd) & MASK;
+            e[i - 1] = std::int64_t(ce) & MASK;
+            cd >>= 62;
+            ce >>= 62;
+        }
+
+        d[L - 1] = cd;
+        e[L - 1] = ce;
+    }
+
+    // [f g] = [u v; q r] [f g] / 2^62
+    static void updateFG(std::int64_t* f,
+                         std::int64_t* g,
+                         const Matrix& t)
+    {
+        mp_sdlimb_t
+            cf = mp_sdlimb_t(t.u) * f[0] + mp_sdlimb_t(t.v) * g[0],
+            cg = mp_sdlimb_t(t.q) * f[0] + mp_sdlimb_t(t.r) * g[0];
+
+        cf >>= 62;
+        cg >>= 62;
+
+        for (std::size_t i = 1; i < L; ++i) {
+            cf += mp_sdlimb_t(t.u) * f[i] + mp_sdlimb_t(t.v) * g[i];
+            cg += mp_sdlimb_t(t.q) * f[i] + mp_sdlimb_t(t.r) * g[i];
+
+            f[i - 1] = std::int64_t(cf) & MASK;
+            g[i - 1] = std::int64_t(cg) & MASK;
+            cf >>= 62;
+            cg >>= 62;
+        }
+
+        f[L - 1] = cf;
+        g[L - 1] = cg;
+    }
+
+    // d = d * sign mod m in [0, m), d is in (-2m, m)
+    static void normalize(std::int64_t* d,
+                          const std::int64_t sign,
+                          const std::int64_t* p)
+    {
+        // (-m, m) after adding m if negative
+        std::int64_t cond = d[L - 1] >> 63;
+        for (std::size_t i = 0; i < L; ++i)
+            d[i] = ((d[i] + (p[i] & cond)) ^ sign) - sign;
+
+        carry(d);
+
+        // [0, m) after adding m if negative
+        cond = d[L - 1] >> 63;
+        for (std::size_t i = 0; i < L; ++i)
+            d[i] += p[i] & cond;
+
+        carry(d);
+    }
+
+    static void carry(std::int64_t* d) {
+        for (std::size_t i = 0; i + 1 < L; ++i) {
+            d[i + 1] += d[i] >> 62;
+            d[i] &= MASK;
+        }
+    }
+};
+
+#endif
+
+} // namespace snarklib
+
+#endif
@@ -5,10 +5,13 @@
 #include <cassert>
 #include <cstdint>
 #include <gmp.h>
+#include <memory>
 #include <vector>
 #include "AuxSTL.hpp"
 #include "BigInt.hpp"
 #include "ProgressCallback.hpp"
+#include "ThreadPool.hpp"
+#include "Util.hpp"
 
 namespace snarklib {
 
@@ -17,85 +20,101 @@ namespace snarklib {
 //
 
 // wNAF exponentiation (windowed non-adjacent form)
+// The window is chosen from the group wNAF window table by scalar
+// size. Window w has nonzero digits odd and less than 2^w in
+// magnitude, so the table holds 2^(w-1) odd multiples of the base.
+// The window is reduced if this would exceed maxTableSize.
 template <mp_size_t N, typename T>
 T wnafExp(const BigInt<N>& scalar,
-          const T& base)
-{
-/* FIXME - this wNAF code requires intractably large amounts of memory
- *
- *                             BN128          Edwards
- *
- * How often used              50%            60%
- * minimum scalarBits          11             9
- * maximum scalarBits          198            177
- * (from 300 trials for each elliptic curve)
- *
- * The vector table of group elements will often be so large as to
- * exceed addressable memory. This causes the heap allocator to fail
- * and the process to abort. More intelligent algorithm memoization
- * is required.
- *
- * The code is left here (instead of removed) in case there are more
- * ideas which can fix its problems at a future time.
- *
-
+          const T& base,
+          const std::size_t maxTableSize = 1u << 8)
+{
     const std::size_t scalarBits = scalar.numBits();
 
+    std::size_t w = 0;
     for (long i = T::params.wnaf_window_table().size() - 1; i >= 0; --i) {
-        if (scalarBits >= T::params.wnaf_window_table()[i])
-        {
-            const auto NAF = find_wNAF(i + 1, scalar);
-
-            // this table can be huge
-            std::vector<T> table(1u << (scalarBits - 1));
-
-            auto tmp = base;
-            const auto dbl = base.dbl();
-            for (std::size_t i = 0; i < table.size(); ++i) {
-                table[i] = tmp;
-                tmp = tmp + dbl;
-            }
+        if (scalarBits >= T::params.wnaf_window_table()[i]) {
+            w = i + 1;
+            break;
+        }
+    }
 
-            auto res = T::zero();
-
-            bool found_nonzero = false;
-            for (long i = NAF.size() - 1; i >= 0; --i) {
-                if (found_nonzero) {
-                    res = res.dbl();
-                }
-
-                if (NAF[i] != 0) {
-                    found_nonzero = true;
-                    if (NAF[i] > 0) {
-                        res = res + table[NAF[i] / 2];
-                    } else {
-                        res = res - table[(-NAF[i]) / 2];
-                    }
-                }
-            }
+    // memory cap
+    while (w > 1 && (1u << (w - 1)) > maxTableSize) {
+        --w;
+    }
 
-            return res;
+    if (0 == w) {
+        return scalar * base;
+    }
+
+    const auto NAF = find_wNAF(w, scalar);
+
+    // odd multiples: base, 3 * base, 5 * base, ...
+    std::vector<T> table;
+    table.reserve(1u << (w - 1));
+
+    auto tmp = base;
+    const auto dbl = base.dbl();
+    for (std::size_t i = 0; i < (1u << (w - 1)); ++i) {
+        table.emplace_back(tmp);
+        tmp = tmp + dbl;
+    }
+
+    auto res = T::zero();
+
+    bool found_nonzero = false;
+    for (long i = NAF.size() - 1; i >= 0; --i) {
+        if (found_nonzero) {
+            res = res.dbl();
+        }
+
+        if (NAF[i] != 0) {
+            found_nonzero = true;
+            if (NAF[i] > 0) {
+                res = res + table[NAF[i] / 2];
+            } else {
+                res = res - table[(-NAF[i]) / 2];
+            }
         }
     }
-*/
 
-    return scalar * base;
+    return res;
 }
 
-// calculates sum(scalar[i] * base[i])
+// scratch memory for multi-exponentiation, may be reused
+// Only the bases changed by reweighting are copied. The multiExp01()
+// index list selects the terms which are not zero or one.
 template <typename T, typename F>
-T multiExp(const std::vector<T>& base,
-           const std::vector<F>& scalar,
-           ProgressCallback* callback = nullptr)
+struct MultiExpArena
+{
+    typedef OrdPair<BigInt<F::BaseType::numberLimbs()>, std::size_t> ScalarIndex;
+
+    PriorityQueue<ScalarIndex> scalarPQ;
+    std::vector<T> base;
+    std::vector<std::size_t> index;
+
+    // keeps the memory
+    void clear() {
+        scalarPQ.clear();
+        base.clear();
+        index.clear();
+    }
+};
+
+// calculates sum(scalarAt(i) * baseAt(i)) for i in [0, numTerms)
+// baseAt(i) and scalarAt(i) return references into the caller's data
+template <typename T, typename F, typename BASE_AT, typename SCALAR_AT>
+T multiExpView(const std::size_t numTerms,
+               BASE_AT baseAt,
+               SCALAR_AT scalarAt,
+               MultiExpArena<T, F>& arena,
+               ProgressCallback* callback = nullptr)
 {
     const std::size_t M = callback ? callback->minorSteps() : 0;
     std::size_t progressCount = 0, callbackCount = 0;
 
-#ifdef USE_ASSERT
-    assert(base.size() == scalar.size());
-#endif
-
-    if (base.empty()) {
+    if (0 == numTerms) {
         // final callbacks
         for (std::size_t i = callbackCount; i < M; ++i)
             callback->minor();
@@ -103,24 +122,31 @@ T multiExp(const std::vector<T>& base,
         return T::zero();
     }
 
-    if (1 == base.size()) {
+    if (1 == numTerms) {
         // final callbacks
         for (std::size_t i = callbackCount; i < M; ++i)
             callback->minor();
 
-        return scalar[0][0] * base[0];
+        return scalarAt(0)[0] * baseAt(0);
     }
 
-    std::vector<T> baseVec(base);
-
     const mp_size_t N = F::BaseType::numberLimbs();
-    typedef OrdPair<BigInt<N>, std::size_t> ScalarIndex;
+    typedef typename MultiExpArena<T, F>::ScalarIndex ScalarIndex;
+
+    // heap values past numTerms are reweighted bases in the arena
+    auto& scalarPQ = arena.scalarPQ;
+    auto& baseVec = arena.base;
+    scalarPQ.clear();
+    baseVec.clear();
+    scalarPQ.reserve(numTerms);
 
-    PriorityQueue<ScalarIndex> scalarPQ(base.size());
+    const auto baseOf = [&] (const std::size_t value) -> const T& {
+        return value < numTerms ? baseAt(value) : baseVec[value - numTerms];
+    };
 
-    for (std::size_t i = 0; i < scalar.size(); ++i) {
+    for (std::size_t i = 0; i < numTerms; ++i) {
         scalarPQ.push(
-            ScalarIndex(scalar[i][0].asBigInt(), i));
+            ScalarIndex(scalarAt(i)[0].asBigInt(), i));
     }
 
     auto res = T::zero();
@@ -148,18 +174,26 @@ T multiExp(const std::vector<T>& base,
 
             // xA + yB = xA - yA + yB + yA = (x - y)A + y(B + A)
             mpn_sub_n(a.key.data(), a.key.data(), b.key.data(), N);
-            baseVec[b.value] = baseVec[b.value] + baseVec[a.value];
+            const auto sum = baseOf(b.value) + baseOf(a.value);
+
+            // copy on first write, key of b is unchanged
+            if (b.value < numTerms) {
+                b.value = numTerms + baseVec.size();
+                baseVec.emplace_back(sum);
+            } else {
+                baseVec[b.value - numTerms] = sum;
+            }
 
             scalarPQ.push(
                 ScalarIndex(a.key, a.value));
 
         } else {
-            res = res + wnafExp(a.key, baseVec[a.value]);
+            res = res + wnafExp(a.key, baseOf(a.value));
         }
 
         // progress on the max-heap is difficult to estimate, use
         // heuristic of iteration over original size as one unit
-        if (callbackCount < M && (scalar.size() == ++progressCount)) {
+        if (callbackCount < M && (numTerms == ++progressCount)) {
             progressCount = 0;
             ++callbackCount;
             callback->minor();
@@ -173,46 +207,248 @@ T multiExp(const std::vector<T>& base,
     return res;
 }
 
-// sum of multi-exponentiation when scalar vector has many zeros and ones
+// calculates sum(scalar[i] * base[i])
 template <typename T, typename F>
-T multiExp01(const std::vector<T>& base,
-             const std::vector<F>& scalar,
-             const std::size_t reserveCount, // for performance tuning
-             ProgressCallback* callback)
+T multiExp(const std::vector<T>& base,
+           const std::vector<F>& scalar,
+           ProgressCallback* callback = nullptr)
+{
+#ifdef USE_ASSERT
+    assert(base.size() == scalar.size());
+#endif
+
+    MultiExpArena<T, F> arena;
+
+    return multiExpView(
+        base.size(),
+        [&base] (const std::size_t i) -> const T& { return base[i]; },
+        [&scalar] (const std::size_t i) -> const F& { return scalar[i]; },
+        arena,
+        callback);
+}
+
+// calculates sum(scalar[i - startIndex] * base[i]) for i in
+// [startIndex, stopIndex) without copying the vectors
+template <typename T, typename F>
+T multiExp(const std::vector<T>& base,
+           const std::vector<F>& scalar,
+           const std::size_t startIndex,
+           const std::size_t stopIndex,
+           MultiExpArena<T, F>& arena,
+           ProgressCallback* callback = nullptr)
+{
+#ifdef USE_ASSERT
+    assert(startIndex <= stopIndex &&
+           stopIndex <= base.size() &&
+           stopIndex - startIndex <= scalar.size());
+#endif
+
+    return multiExpView(
+        stopIndex - startIndex,
+        [&base, startIndex] (const std::size_t i) -> const T& {
+            return base[startIndex + i];
+        },
+        [&scalar] (const std::size_t i) -> const F& { return scalar[i]; },
+        arena,
+        callback);
+}
+
+// bucket window size minimizing group additions for vector length
+inline
+std::size_t bucketWindowBits(const std::size_t scalarBits,
+                             const std::size_t vecSize)
+{
+    std::size_t bestBits = 1, bestCost = -1;
+
+    for (std::size_t c = 1; c <= 20; ++c) {
+        // each window: one addition per term into buckets
+        // and two per bucket for the running sum
+        const std::size_t cost
+            = ((scalarBits + c - 1) / c) * (vecSize + (2u << c));
+
+        if (cost < bestCost) {
+            bestBits = c;
+            bestCost = cost;
+        }
+    }
+
+    return bestBits;
+}
+
+// calculates sum(scalarAt(i) * baseAt(i)) with buckets (Pippenger)
+template <typename T, typename F, typename BASE_AT, typename SCALAR_AT>
+T multiExpBucketView(const std::size_t numTerms,
+                     BASE_AT baseAt,
+                     SCALAR_AT scalarAt,
+                     ProgressCallback* callback = nullptr)
+{
+    const std::size_t M = callback ? callback->minorSteps() : 0;
+    std::size_t callbackCount = 0;
+
+    if (0 == numTerms) {
+        // final callbacks
+        for (std::size_t i = callbackCount; i < M; ++i)
+            callback->minor();
+
+        return T::zero();
+    }
+
+    const mp_size_t N = F::BaseType::numberLimbs();
+
+    std::vector<BigInt<N>> scalarVec;
+    scalarVec.reserve(numTerms);
+    for (std::size_t i = 0; i < numTerms; ++i) {
+        scalarVec.emplace_back(scalarAt(i)[0].asBigInt());
+    }
+
+    const std::size_t
+        scalarBits = F::BaseType::sizeInBits(),
+        windowBits = bucketWindowBits(scalarBits, numTerms),
+        numWindows = (scalarBits + windowBits - 1) / windowBits;
+
+    std::vector<T> bucket((1u << windowBits) - 1, T::zero());
+
+    auto res = T::zero();
+
+    // most significant window first, Horner's rule over windows
+    for (long w = numWindows - 1; w >= 0; --w) {
+        for (std::size_t i = 0; i < windowBits; ++i)
+            res = res.dbl();
+
+        for (auto& r : bucket)
+            r = T::zero();
+
+        const std::size_t offset = w * windowBits;
+
+        for (std::size_t i = 0; i < numTerms; ++i) {
+            const auto digit = scalarVec[i].getBits(offset, windowBits);
+
+            if (digit) {
+                auto& b = bucket[digit - 1];
+#ifdef USE_ADD_SPECIAL
+                // proving key queries are in special form after batchSpecial()
+                b = baseAt(i).isSpecial()
+                    ? fastAddSpecial(b, baseAt(i))
+                    : b + baseAt(i);
+#else
+                b = b + baseAt(i);
+#endif
+            }
+        }
+
+        // sum(digit * bucket[digit - 1]) from running sums
+        auto runningSum = T::zero(), windowSum = T::zero();
+        for (long j = bucket.size() - 1; j >= 0; --j) {
+            runningSum = runningSum + bucket[j];
+            windowSum = windowSum + runningSum;
+        }
+
+        res = res + windowSum;
+
+        // spread callbacks evenly over the windows
+        const std::size_t windowCount = numWindows - w;
+        while (callbackCount < M * windowCount / numWindows) {
+            ++callbackCount;
+            callback->minor();
+        }
+    }
+
+    // final callbacks
+    for (std::size_t i = callbackCount; i < M; ++i)
+        callback->minor();
+
+    return res;
+}
+
+// calculates sum(scalar[i] * base[i]) with buckets (Pippenger)
+template <typename T, typename F>
+T multiExpBucket(const std::vector<T>& base,
+                 const std::vector<F>& scalar,
+                 ProgressCallback* callback = nullptr)
+{
+#ifdef USE_ASSERT
+    assert(base.size() == scalar.size());
+#endif
+
+    return multiExpBucketView<T, F>(
+        base.size(),
+        [&base] (const std::size_t i) -> const T& { return base[i]; },
+        [&scalar] (const std::size_t i) -> const F& { return scalar[i]; },
+        callback);
+}
+
+// sum of multi-exponentiation when scalars have many zeros and ones
+// Ones are added directly. The other terms are listed by index in the
+// arena instead of copied.
+template <typename T, typename F, typename BASE_AT, typename SCALAR_AT>
+T multiExp01View(const std::size_t numTerms,
+                 BASE_AT baseAt,
+                 SCALAR_AT scalarAt,
+                 const std::size_t reserveCount, // for performance tuning
+                 MultiExpArena<T, F>& arena,
+                 ProgressCallback* callback = nullptr)
 {
     const auto
         ZERO = F::zero(),
         ONE = F::one();
 
-    std::vector<T> base2;
-    std::vector<F> scalar2;
+    auto& index = arena.index;
+    index.clear();
     if (reserveCount) {
-        base2.reserve(reserveCount);
-        scalar2.reserve(reserveCount);
+        index.reserve(reserveCount);
     }
 
     auto accum = T::zero();
 
-    for (std::size_t i = 0; i < base.size(); ++i) {
-        const auto a = scalar[i];
+    for (std::size_t i = 0; i < numTerms; ++i) {
+        const auto& a = scalarAt(i);
 
         if (ZERO == a) {
             continue;
 
         } else if (ONE == a) {
 #ifdef USE_ADD_SPECIAL
-            accum = fastAddSpecial(accum, base[i]);
+            accum = fastAddSpecial(accum, baseAt(i));
 #else
-            accum = accum + base[i];
+            accum = accum + baseAt(i);
 #endif
 
         } else {
-            base2.emplace_back(base[i]);
-            scalar2.emplace_back(a);
+            index.push_back(i);
         }
     }
 
-    return accum + multiExp(base2, scalar2, callback);
+    const auto base2 = [&baseAt, &index] (const std::size_t i) -> const T& {
+        return baseAt(index[i]);
+    };
+
+    const auto scalar2 = [&scalarAt, &index] (const std::size_t i) -> const F& {
+        return scalarAt(index[i]);
+    };
+
+#ifdef USE_PIPPENGER
+    return accum + multiExpBucketView<T, F>(index.size(), base2, scalar2, callback);
+#else
+    return accum + multiExpView(index.size(), base2, scalar2, arena, callback);
+#endif
+}
+
+// sum of multi-exponentiation when scalar vector has many zeros and ones
+template <typename T, typename F>
+T multiExp01(const std::vector<T>& base,
+             const std::vector<F>& scalar,
+             const std::size_t reserveCount, // for performance tuning
+             ProgressCallback* callback)
+{
+    MultiExpArena<T, F> arena;
+
+    return multiExp01View(
+        base.size(),
+        [&base] (const std::size_t i) -> const T& { return base[i]; },
+        [&scalar] (const std::size_t i) -> const F& { return scalar[i]; },
+        reserveCount,
+        arena,
+        callback);
 }
 
 // sum of multi-exponentiation when scalar vector has many zeros and ones
@@ -224,6 +460,183 @@ T multiExp01(const std::vector<T>& base,
     return multiExp01(base, scalar, 0, callback);
 }
 
+// sum of multi-exponentiation when scalar vector has many zeros and ones
+// calculates sum(scalar[i - startIndex] * base[i]) for i in
+// [startIndex, stopIndex) without copying the vectors
+template <typename T, typename F>
+T multiExp01(const std::vector<T>& base,
+             const std::vector<F>& scalar,
+             const std::size_t startIndex,
+             const std::size_t stopIndex,
+             const std::size_t reserveCount, // for performance tuning
+             MultiExpArena<T, F>& arena,
+             ProgressCallback* callback = nullptr)
+{
+#ifdef USE_ASSERT
+    assert(startIndex <= stopIndex &&
+           stopIndex <= base.size() &&
+           stopIndex - startIndex <= scalar.size());
+#endif
+
+    return multiExp01View(
+        stopIndex - startIndex,
+        [&base, startIndex] (const std::size_t i) -> const T& {
+            return base[startIndex + i];
+        },
+        [&scalar] (const std::size_t i) -> const F& { return scalar[i]; },
+        reserveCount,
+        arena,
+        callback);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// multi-threaded multi-exponentiation
+//
+// The vectors are partitioned into one block for each thread. Partial
+// sums from the blocks are added in block order so the result for a
+// given number of threads is always the same. Blocks use the bucket
+// method if USE_PIPPENGER is defined, like multiExp01View().
+//
+
+// calculates sum(scalar[i] * base[i]) on a thread pool
+template <typename T, typename F>
+T multiExp(const std::vector<T>& base,
+           const std::vector<F>& scalar,
+           ThreadPool& pool,
+           ProgressCallback* callback = nullptr)
+{
+#ifdef USE_ASSERT
+    assert(base.size() == scalar.size());
+#endif
+
+    const std::size_t numBlocks = std::min(base.size(), pool.numThreads());
+
+    if (numBlocks <= 1) {
+#ifdef USE_PIPPENGER
+        return multiExpBucket(base, scalar, callback);
+#else
+        return multiExp(base, scalar, callback);
+#endif
+    }
+
+    ProgressCallback_Blocks blockCB(callback, numBlocks);
+    ProgressCallback* cb = callback ? std::addressof(blockCB) : nullptr;
+
+    std::vector<T> partialSum(numBlocks, T::zero());
+
+    pool.blockPartition(
+        base.size(),
+        [&] (const std::size_t block,
+             const std::size_t startIndex,
+             const std::size_t stopIndex) {
+            const auto baseAt = [&base, startIndex] (const std::size_t i) -> const T& {
+                return base[startIndex + i];
+            };
+
+            const auto scalarAt = [&scalar, startIndex] (const std::size_t i) -> const F& {
+                return scalar[startIndex + i];
+            };
+
+            // same algorithm as the single-threaded view paths
+#ifdef USE_PIPPENGER
+            partialSum[block] = multiExpBucketView<T, F>(
+                stopIndex - startIndex, baseAt, scalarAt, cb);
+#else
+            MultiExpArena<T, F> arena;
+
+            partialSum[block] = multiExpView(
+                stopIndex - startIndex, baseAt, scalarAt, arena, cb);
+#endif
+        });
+
+    auto res = T::zero();
+    for (const auto& a : partialSum) {
+        res = res + a;
+    }
+
+    return res;
+}
+
+// sum of multi-exponentiation with many zeros and ones on a thread pool
+// calculates sum(scalar[i - startIndex] * base[i]) for i in
+// [startIndex, stopIndex) without copying the vectors
+template <typename T, typename F>
+T multiExp01(const std::vector<T>& base,
+             const std::vector<F>& scalar,
+             const std::size_t startIndex,
+             const std::size_t stopIndex,
+             const std::size_t reserveCount, // for performance tuning
+             ThreadPool& pool,
+             ProgressCallback* callback = nullptr)
+{
+#ifdef USE_ASSERT
+    assert(startIndex <= stopIndex &&
+           stopIndex <= base.size() &&
+           stopIndex - startIndex <= scalar.size());
+#endif
+
+    const std::size_t numBlocks = std::min(stopIndex - startIndex, pool.numThreads());
+
+    if (numBlocks <= 1) {
+        MultiExpArena<T, F> arena;
+
+        return multiExp01(base, scalar, startIndex, stopIndex, reserveCount, arena, callback);
+    }
+
+    ProgressCallback_Blocks blockCB(callback, numBlocks);
+    ProgressCallback* cb = callback ? std::addressof(blockCB) : nullptr;
+
+    std::vector<T> partialSum(numBlocks, T::zero());
+
+    pool.blockPartition(
+        stopIndex - startIndex,
+        [&] (const std::size_t block,
+             const std::size_t a,
+             const std::size_t b) {
+            MultiExpArena<T, F> arena;
+
+            partialSum[block] = multiExp01View(
+                b - a,
+                [&base, startIndex, a] (const std::size_t i) -> const T& {
+                    return base[startIndex + a + i];
+                },
+                [&scalar, a] (const std::size_t i) -> const F& {
+                    return scalar[a + i];
+                },
+                reserveCount / numBlocks,
+                arena,
+                cb);
+        });
+
+    auto res = T::zero();
+    for (const auto& a : partialSum) {
+        res = res + a;
+    }
+
+    return res;
+}
+
+// sum of multi-exponentiation with many zeros and ones on a thread pool
+template <typename T, typename F>
+T multiExp01(const std::vector<T>& base,
+             const std::vector<F>& scalar,
+             const std::size_t reserveCount, // for performance tuning
+             ThreadPool& pool,
+             ProgressCallback* callback = nullptr)
+{
+    return multiExp01(base, scalar, 0, base.size(), reserveCount, pool, callback);
+}
+
+// sum of multi-exponentiation with many zeros and ones on a thread pool
+template <typename T, typename F>
+T multiExp01(const std::vector<T>& base,
+             const std::vector<F>& scalar,
+             ThreadPool& pool,
+             ProgressCallback* callback = nullptr)
+{
+    return multiExp01(base, scalar, 0, pool, callback);
+}
+
 } // namespace snarklib
 
 #endif
@@ -14,6 +14,7 @@
 #include "ProgressCallback.hpp"
 #include "QAP.hpp"
 #include "Rank1DSL.hpp"
+#include "ThreadPool.hpp"
 #include "WindowExp.hpp"
 
 namespace snarklib {
@@ -47,6 +48,62 @@ public:
                  const std::size_t numCircuitInputs,
                  const PPZK_KeypairRandomness<Fr>& keyRand,
                  ProgressCallback* callback = nullptr)
+    {
+        generate(constraintSystem, numCircuitInputs, keyRand, nullptr, callback);
+    }
+
+    PPZK_Keypair(const R1System<Fr>& constraintSystem,
+                 const std::size_t numCircuitInputs,
+                 const PPZK_KeypairRandomness<Fr>& keyRand,
+                 ThreadPool& pool,
+                 ProgressCallback* callback = nullptr)
+    {
+        generate(constraintSystem, numCircuitInputs, keyRand,
+                 std::addressof(pool), callback);
+    }
+
+    const PPZK_ProvingKey<PAIRING>& pk() const { return m_pk; }
+    const PPZK_VerificationKey<PAIRING>& vk() const { return m_vk; }
+
+    bool operator== (const PPZK_Keypair& other) const {
+        return
+            pk() == other.pk() &&
+            vk() == other.vk();
+    }
+
+    bool operator!= (const PPZK_Keypair& other) const {
+        return ! (*this == other);
+    }
+
+    void marshal_out(std::ostream& os) const {
+        pk().marshal_out(os);
+        vk().marshal_out(os);
+    }
+
+    bool marshal_in(std::istream& is) {
+        return
+            m_pk.marshal_in(is) &&
+            m_vk.marshal_in(is);
+    }
+
+    void clear() {
+        m_pk.clear();
+        m_vk.clear();
+    }
+
+    bool empty() const {
+        return
+            m_pk.empty() ||
+            m_vk.empty();
+    }
+
+private:
+    // window tables are built on the thread pool if there is one
+    void generate(const R1System<Fr>& constraintSystem,
+                  const std::size_t numCircuitInputs,
+                  const PPZK_KeypairRandomness<Fr>& keyRand,
+                  ThreadPool* pool,
+                  ProgressCallback* callback)
     {
         ProgressCallback_NOP<PAIRING> dummyNOP;
         ProgressCallback* dummy = callback ? callback : std::addressof(dummyNOP);
@@ -67,25 +124,54 @@ public:
         const QAP_SystemPoint<Fr> qap(constraintSystem, numCircuitInputs, point);
 
         // ABCH
-        QAP_QueryA<Fr> At(qap); // changed by QAP_QueryIC side-effect
-        const QAP_QueryB<Fr> Bt(qap);
-        const QAP_QueryC<Fr> Ct(qap);
-        const QAP_QueryH<Fr> Ht(qap);
+        QAP_QueryA<Fr> At = pool // changed by QAP_QueryIC side-effect
+            ? QAP_QueryA<Fr>(qap, *pool)
+            : QAP_QueryA<Fr>(qap);
+        const QAP_QueryB<Fr> Bt = pool
+            ? QAP_QueryB<Fr>(qap, *pool)
+            : QAP_QueryB<Fr>(qap);
+        const QAP_QueryC<Fr> Ct = pool
+            ? QAP_QueryC<Fr>(qap, *pool)
+            : QAP_QueryC<Fr>(qap);
+        const QAP_QueryH<Fr> Ht = pool
+            ? QAP_QueryH<Fr>(qap, *pool)
+            : QAP_QueryH<Fr>(qap);
+
+#ifdef USE_SIGNED_WINDOW
+        const bool signedDigits = true;
+#else
+        const bool signedDigits = false;
+#endif
 
         // step 8 - G1 window table
         dummy->major(true);
-        const WindowExp<G1> g1_table(g1_exp_count(qap, At, Bt, Ct, Ht), callback);
+        WindowExp<G1> g1_table = pool
+            ? WindowExp<G1>(g1_exp_count(qap, At, Bt, Ct, Ht), signedDigits, *pool, callback)
+            : WindowExp<G1>(g1_exp_count(qap, At, Bt, Ct, Ht), signedDigits, callback);
+#ifdef USE_SPECIAL_WINDOW
+        g1_table.batchSpecial();
+#endif
 
         // step 7 - G2 window table
         dummy->major(true);
-        const WindowExp<G2> g2_table(g2_exp_count(Bt), callback);
+        WindowExp<G2> g2_table = pool
+            ? WindowExp<G2>(g2_exp_count(Bt), signedDigits, *pool, callback)
+            : WindowExp<G2>(g2_exp_count(Bt), signedDigits, callback);
+#ifdef USE_SPECIAL_WINDOW
+        g2_table.batchSpecial();
+#endif
 
         // step 6 - K
         dummy->major(true);
-        const QAP_QueryK<Fr> Kt(qap, At, Bt, Ct, rA, rB, beta);
+        const QAP_QueryK<Fr> Kt = pool
+            ? QAP_QueryK<Fr>(qap, At, Bt, Ct, rA, rB, beta, *pool)
+            : QAP_QueryK<Fr>(qap, At, Bt, Ct, rA, rB, beta);
         const BlockVector<Fr> Ktb(BlockVector<Fr>::space(Kt.vec()), 0, Kt.vec());
         PPZK_QueryK<PAIRING> Kp(Ktb);
-        Kp.accumTable(g1_table, callback);
+        if (pool)
+            Kp.accumTable(g1_table, *pool, callback);
+        else
+            Kp.accumTable(g1_table, callback);
 #ifdef USE_ADD_SPECIAL
         batchSpecial(Kp.llvec());
 #endif
@@ -97,25 +183,37 @@ public:
         dummy->major(true);
         const BlockVector<Fr> Atb(BlockVector<Fr>::space(At.vec()), 0, At.vec());
         PPZK_QueryA<PAIRING> Ap(Atb, rA, alphaA);
-        Ap.accumTable(g1_table, g1_table, callback);
+        if (pool)
+            Ap.accumTable(g1_table, g1_table, *pool, callback);
+        else
+            Ap.accumTable(g1_table, g1_table, callback);
 
         // step 4 - B
         dummy->major(true);
         const BlockVector<Fr> Btb(BlockVector<Fr>::space(Bt.vec()), 0, Bt.vec());
         PPZK_QueryB<PAIRING> Bp(Btb, rB, alphaB);
-        Bp.accumTable(g2_table, g1_table, callback);
+        if (pool)
+            Bp.accumTable(g2_table, g1_table, *pool, callback);
+        else
+            Bp.accumTable(g2_table, g1_table, callback);
 
         // step 3 - C
         dummy->major(true);
         const BlockVector<Fr> Ctb(BlockVector<Fr>::space(Ct.vec()), 0, Ct.vec());
         PPZK_QueryC<PAIRING> Cp(Ctb, rC, alphaC);
-        Cp.accumTable(g1_table, g1_table, callback);
+        if (pool)
+            Cp.accumTable(g1_table, g1_table, *pool, callback);
+        else
+            Cp.accumTable(g1_table, g1_table, callback);
 
         // step 2 - H
         dummy->major(true);
         const BlockVector<Fr> Htb(BlockVector<Fr>::space(Ht.vec()), 0, Ht.vec());
         PPZK_QueryH<PAIRING> Hp(Htb);
-        Hp.accumTable(g1_table, callback);
+        if (pool)
+            Hp.accumTable(g1_table, *pool, callback);
+        else
+            Hp.accumTable(g1_table, callback);
 
         m_pk = PPZK_ProvingKey<PAIRING>(Ap.vec(),
                                         Bp.vec(),
@@ -126,7 +224,10 @@ public:
         // step 1 - input consistency
         dummy->major(true);
         PPZK_QueryIC<PAIRING> ppzkIC(qapIC.vec());
-        ppzkIC.accumTable(g1_table, callback);
+        if (pool)
+            ppzkIC.accumTable(g1_table, *pool, callback);
+        else
+            ppzkIC.accumTable(g1_table, callback);
 
         m_vk = PPZK_VerificationKey<PAIRING>(alphaA * G2::one(),
                                              alphaB * G1::one(),
@@ -138,42 +239,6 @@ public:
                                              ppzkIC);
     }
 
-    const PPZK_ProvingKey<PAIRING>& pk() const { return m_pk; }
-    const PPZK_VerificationKey<PAIRING>& vk() const { return m_vk; }
-
-    bool operator== (const PPZK_Keypair& other) const {
-        return
-            pk() == other.pk() &&
-            vk() == other.vk();
-    }
-
-    bool operator!= (const PPZK_Keypair& other) const {
-        return ! (*this == other);
-    }
-
-    void marshal_out(std::ostream& os) const {
-        pk().marshal_out(os);
-        vk().marshal_out(os);
-    }
-
-    bool marshal_in(std::istream& is) {
-        return
-            m_pk.marshal_in(is) &&
-            m_vk.marshal_in(is);
-    }
-
-    void clear() {
-        m_pk.clear();
-        m_vk.clear();
-    }
-
-    bool empty() const {
-        return
-            m_pk.empty() ||
-            m_vk.empty();
-    }
-
-private:
     PPZK_ProvingKey<PAIRING> m_pk;
     PPZK_VerificationKey<PAIRING> m_vk;
 };
@@ -5,6 +5,7 @@
 #include <istream>
 #include <memory>
 #include <ostream>
+#include <vector>
 #include "AuxSTL.hpp"
 #include "Pairing.hpp"
 #include "PPZK_keystruct.hpp"
@@ -13,6 +14,7 @@
 #include "ProgressCallback.hpp"
 #include "QAP.hpp"
 #include "Rank1DSL.hpp"
+#include "ThreadPool.hpp"
 
 namespace snarklib {
 
@@ -55,71 +57,21 @@ public:
                const std::size_t reserveTune,
                ProgressCallback* callback)
     {
-        ProgressCallback_NOP<PAIRING> dummyNOP;
-        ProgressCallback* dummy = callback ? callback : std::addressof(dummyNOP);
-        dummy->majorSteps(5);
-
-        // randomness
-        const auto
-            &d1 = proofRand.d1(),
-            &d2 = proofRand.d2(),
-            &d3 = proofRand.d3();
-
-        const QAP_SystemPoint<Fr> qap(constraintSystem, numCircuitInputs);
-
-        // ABCH
-        QAP_WitnessA<Fr> aA(qap, witness);
-        QAP_WitnessB<Fr> aB(qap, witness);
-        QAP_WitnessC<Fr> aC(qap, witness);
-        QAP_WitnessH<Fr> aH(qap, aA, aB, d1, d2, d3);
-
-        aA.cosetFFT();
-        aB.cosetFFT();
-        aC.cosetFFT();
-
-        aH.addTemporary(QAP_WitnessH<Fr>(qap, aA, aB, aC));
-
-        const auto& A_query = pk.A_query();
-        const auto& B_query = pk.B_query();
-        const auto& C_query = pk.C_query();
-        const auto& H_query = pk.H_query();
-        const auto& K_query = pk.K_query();
-
-        // step 5 - A
-        dummy->major(true);
-        PPZK_WitnessA<PAIRING> Aw(qap, witness, d1);
-        Aw.accumQuery(A_query, reserveTune, callback);
-        m_A = Aw.val();
-
-        // step 4 - B
-        dummy->major(true);
-        PPZK_WitnessB<PAIRING> Bw(qap, witness, d2);
-        Bw.accumQuery(B_query, reserveTune, callback);
-        m_B = Bw.val();
-
-        // step 3 - C
-        dummy->major(true);
-        PPZK_WitnessC<PAIRING> Cw(qap, witness, d3);
-        Cw.accumQuery(C_query, reserveTune, callback);
-        m_C = Cw.val();
-
-        // step 2 - H
-        dummy->major(true);
-        PPZK_WitnessH<PAIRING> Hw;
-        Hw.accumQuery(
-            BlockVector<G1>(BlockVector<G1>::space(H_query), 0, H_query),
-            BlockVector<Fr>(BlockVector<Fr>::space(aH.vec()), 0, aH.vec()),
-            callback);
-        m_H = Hw.val();
+        prove(constraintSystem, numCircuitInputs, pk, witness, proofRand,
+              reserveTune, nullptr, callback);
+    }
 
-        // step 1 - K
-        dummy->major(true);
-        PPZK_WitnessK<PAIRING> Kw(witness, d1, d2, d3);
-        Kw.accumQuery(
-            BlockVector<G1>(BlockVector<G1>::space(K_query), 0, K_query),
-            reserveTune,
-            callback);
-        m_K = Kw.val();
+    PPZK_Proof(const R1System<Fr>& constraintSystem,
+               const std::size_t numCircuitInputs,
+               const PPZK_ProvingKey<PAIRING>& pk,
+               const R1Witness<Fr>& witness,
+               const PPZK_ProofRandomness<Fr>& proofRand,
+               const std::size_t reserveTune,
+               ThreadPool& pool,
+               ProgressCallback* callback = nullptr)
+    {
+        prove(constraintSystem, numCircuitInputs, pk, witness, proofRand,
+              reserveTune, std::addressof(pool), callback);
     }
 
     PPZK_Proof(const R1System<Fr>& constraintSystem,
@@ -194,6 +146,105 @@ public:
     }
 
 private:
+    // witness vectors A, B, C, their transforms and the multi-exponentiations
+    // use the thread pool if there is one
+    void prove(const R1System<Fr>& constraintSystem,
+               const std::size_t numCircuitInputs,
+               const PPZK_ProvingKey<PAIRING>& pk,
+               const R1Witness<Fr>& witness,
+               const PPZK_ProofRandomness<Fr>& proofRand,
+               const std::size_t reserveTune,
+               ThreadPool* pool,
+               ProgressCallback* callback)
+    {
+        ProgressCallback_NOP<PAIRING> dummyNOP;
+        ProgressCallback* dummy = callback ? callback : std::addressof(dummyNOP);
+        dummy->majorSteps(5);
+
+        // randomness
+        const auto
+            &d1 = proofRand.d1(),
+            &d2 = proofRand.d2(),
+            &d3 = proofRand.d3();
+
+        const QAP_SystemPoint<Fr> qap(constraintSystem, numCircuitInputs);
+
+        // ABCH, A, B, C are filled together and transforms are batched
+        std::vector<std::vector<Fr>*> batchABC;
+        QAP_WitnessA<Fr> aA(qap, batchABC);
+        QAP_WitnessB<Fr> aB(qap, batchABC);
+        QAP_WitnessC<Fr> aC(qap, batchABC);
+
+        if (pool) {
+            fillWitnessABC(qap, witness, aA, aB, aC, *pool);
+            qap.FFT()->iFFT(batchABC, *pool);
+        } else {
+            fillWitnessABC(qap, witness, aA, aB, aC);
+            qap.FFT()->iFFT(batchABC);
+        }
+
+        if (pool)
+            qap.FFT()->cosetFFT(batchABC, Fr::params.multiplicative_generator(), *pool);
+        else
+            qap.FFT()->cosetFFT(batchABC, Fr::params.multiplicative_generator());
+
+        const QAP_WitnessH<Fr> aH(qap, aA, aB, aC, d1, d2, d3);
+
+        const auto& A_query = pk.A_query();
+        const auto& B_query = pk.B_query();
+        const auto& C_query = pk.C_query();
+        const auto& H_query = pk.H_query();
+        const auto& K_query = pk.K_query();
+
+        // step 5 - A
+        dummy->major(true);
+        PPZK_WitnessA<PAIRING> Aw(qap, witness, d1);
+        if (pool)
+            Aw.accumQuery(A_query, reserveTune, *pool, callback);
+        else
+            Aw.accumQuery(A_query, reserveTune, callback);
+        m_A = Aw.val();
+
+        // step 4 - B
+        dummy->major(true);
+        PPZK_WitnessB<PAIRING> Bw(qap, witness, d2);
+        if (pool)
+            Bw.accumQuery(B_query, reserveTune, *pool, callback);
+        else
+            Bw.accumQuery(B_query, reserveTune, callback);
+        m_B = Bw.val();
+
+        // step 3 - C
+        dummy->major(true);
+        PPZK_WitnessC<PAIRING> Cw(qap, witness, d3);
+        if (pool)
+            Cw.accumQuery(C_query, reserveTune, *pool, callback);
+        else
+            Cw.accumQuery(C_query, reserveTune, callback);
+        m_C = Cw.val();
+
+        // step 2 - H
+        dummy->major(true);
+        PPZK_WitnessH<PAIRING> Hw;
+        const BlockVector<G1> Hq(BlockVector<G1>::space(H_query), 0, H_query);
+        const BlockVector<Fr> Hs(BlockVector<Fr>::space(aH.vec()), 0, aH.vec());
+        if (pool)
+            Hw.accumQuery(Hq, Hs, *pool, callback);
+        else
+            Hw.accumQuery(Hq, Hs, callback);
+        m_H = Hw.val();
+
+        // step 1 - K
+        dummy->major(true);
+        PPZK_WitnessK<PAIRING> Kw(witness, d1, d2, d3);
+        const BlockVector<G1> Kq(BlockVector<G1>::space(K_query), 0, K_query);
+        if (pool)
+            Kw.accumQuery(Kq, reserveTune, *pool, callback);
+        else
+            Kw.accumQuery(Kq, reserveTune, callback);
+        m_K = Kw.val();
+    }
+
     Pairing<G1, G1> m_A;
     Pairing<G2, G1> m_B;
     Pairing<G1, G1> m_C;
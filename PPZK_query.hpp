@@ -11,6 +11,7 @@
 #include "Pairing.hpp"
 #include "ProgressCallback.hpp"
 #include "Rank1DSL.hpp"
+#include "ThreadPool.hpp"
 #include "WindowExp.hpp"
 
 namespace snarklib {
@@ -49,6 +50,15 @@ public:
                           callback);
     }
 
+    void accumTable(const WindowExp<G1>& g1_table,
+                    ThreadPool& pool,
+                    ProgressCallback* callback = nullptr) {
+        g1_table.batchExp(m_encoded_terms,
+                          m_coeffs,
+                          pool,
+                          callback);
+    }
+
     PPZK_QueryIC accumWitness(const R1Witness<Fr>& witness) const {
         G1 base = m_base;
         std::vector<G1> encoded_terms;
@@ -167,6 +177,30 @@ public:
         }
     }
 
+    void accumTable(const WindowExp<GA>& ga_table,
+                    const WindowExp<GB>& gb_table,
+                    ThreadPool& pool,
+                    ProgressCallback* callback = nullptr) {
+        if (m_vec.empty()) {
+            m_vec = batchExp(ga_table,
+                             gb_table,
+                             m_random_v,
+                             m_random_prod,
+                             m_qap_query,
+                             pool,
+                             callback);
+        } else {
+            batchExp(m_vec,
+                     ga_table,
+                     gb_table,
+                     m_random_v,
+                     m_random_prod,
+                     m_qap_query,
+                     pool,
+                     callback);
+        }
+    }
+
     const SparseVector<Pairing<GA, GB>>& vec() const { return m_vec; }
 
 private:
@@ -208,6 +242,15 @@ public:
                           callback);
     }
 
+    void accumTable(const WindowExp<G1>& g1_table,
+                    ThreadPool& pool,
+                    ProgressCallback* callback = nullptr) {
+        g1_table.batchExp(m_vec,
+                          m_qap_query,
+                          pool,
+                          callback);
+    }
+
     const BlockVector<G1>& vec() const { return m_vec; }
     const std::vector<G1>& vvec() const { return m_vec.vec(); }
     BlockVector<G1>& lvec() { return m_vec; }
@@ -11,6 +11,7 @@
 #include "ProgressCallback.hpp"
 #include "QAP.hpp"
 #include "Rank1DSL.hpp"
+#include "ThreadPool.hpp"
 
 namespace snarklib {
 
@@ -33,24 +34,31 @@ public:
     void accumQuery(const SparseVector<Pairing<GA, GB>>& query,
                     const std::size_t reserveTune,
                     ProgressCallback* callback) {
-        m_val = m_val
-            + m_random_d * query.getElementForIndex(Z_INDEX)
-            + query.getElementForIndex(3);
+        accumFixed(query);
+
+        m_val = m_val + multiExp01(query,
+                                   m_witness,
+                                   4,
+                                   4 + m_numVariables,
+                                   0 == reserveTune ? 0 : m_numVariables / reserveTune,
+                                   m_arena,
+                                   callback);
+    }
 
-        if (0 == reserveTune) {
-            m_val = m_val + multiExp01(query,
-                                       m_witness,
-                                       4,
-                                       4 + m_numVariables,
-                                       callback);
-        } else {
-            m_val = m_val + multiExp01(query,
-                                       m_witness,
-                                       4,
-                                       4 + m_numVariables,
-                                       m_numVariables / reserveTune,
-                                       callback);
-        }
+    // multi-threaded
+    void accumQuery(const SparseVector<Pairing<GA, GB>>& query,
+                    const std::size_t reserveTune,
+                    ThreadPool& pool,
+                    ProgressCallback* callback = nullptr) {
+        accumFixed(query);
+
+        m_val = m_val + multiExp01(query,
+                                   m_witness,
+                                   4,
+                                   4 + m_numVariables,
+                                   0 == reserveTune ? 0 : m_numVariables / reserveTune,
+                                   pool,
+                                   callback);
     }
 
     void accumQuery(const SparseVector<Pairing<GA, GB>>& query,
@@ -61,10 +69,18 @@ public:
     const Pairing<GA, GB>& val() const { return m_val; }
 
 private:
+    // random_d times the Z term and the constant term
+    void accumFixed(const SparseVector<Pairing<GA, GB>>& query) {
+        m_val = m_val
+            + m_random_d * query.getElementForIndex(Z_INDEX)
+            + query.getElementForIndex(3);
+    }
+
     const std::size_t m_numVariables;
     const std::vector<FR>& m_witness;
     const FR& m_random_d;
     Pairing<GA, GB> m_val;
+    MultiExpArena<Pairing<GA, GB>, FR> m_arena;
 };
 
 template <typename PAIRING> using PPZK_WitnessA =
@@ -98,8 +114,34 @@ public:
                query.block() == scalar.block());
 #endif
 
+#ifdef USE_PIPPENGER
+        m_val = m_val + multiExpBucket(query.vec(),
+                                       scalar.vec(),
+                                       callback);
+#else
         m_val = m_val + multiExp(query.vec(),
                                  scalar.vec(),
+                                 0,
+                                 query.vec().size(),
+                                 m_arena,
+                                 callback);
+#endif
+    }
+
+    // multi-threaded
+    void accumQuery(const BlockVector<G1>& query,
+                    const BlockVector<Fr>& scalar,
+                    ThreadPool& pool,
+                    ProgressCallback* callback = nullptr)
+    {
+#ifdef USE_ASSERT
+        assert(query.space() == scalar.space() &&
+               query.block() == scalar.block());
+#endif
+
+        m_val = m_val + multiExp(query.vec(),
+                                 scalar.vec(),
+                                 pool,
                                  callback);
     }
 
@@ -107,6 +149,7 @@ public:
 
 private:
     G1 m_val;
+    MultiExpArena<G1, Fr> m_arena;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -134,53 +177,66 @@ public:
                     const std::size_t reserveTune,
                     ProgressCallback* callback = nullptr)
     {
-        if (0 == query.block()[0]) {
-#ifdef USE_ASSERT
-            assert(query.size() >= 4);
-#endif
+        // skip the first four elements without copying the query
+        const std::size_t startIndex = accumFixed(query);
+        const std::size_t numTerms = query.vec().size() - startIndex;
+
+        m_val = m_val + multiExp01(
+            query.vec(),
+            m_witness,
+            startIndex,
+            query.vec().size(),
+            0 == reserveTune ? 0 : numTerms / reserveTune,
+            m_arena,
+            callback);
+    }
 
-            m_val = m_val
-                + m_random_d1 * query[0]
-                + m_random_d2 * query[1]
-                + m_random_d3 * query[2]
-                + query[3];
-
-            if (0 == reserveTune) {
-                m_val = m_val + multiExp01(
-                    std::vector<G1>(query.vec().begin() + 4, query.vec().end()),
-                    m_witness,
-                    callback);
-
-            } else {
-                m_val = m_val + multiExp01(
-                    std::vector<G1>(query.vec().begin() + 4, query.vec().end()),
-                    m_witness,
-                    (query.vec().size() - 4) / reserveTune,
-                    callback);
-            }
-
-        } else {
-            if (0 == reserveTune) {
-                m_val = m_val + multiExp01(query.vec(),
-                                           m_witness,
-                                           callback);
-            } else {
-                m_val = m_val + multiExp01(query.vec(),
-                                           m_witness,
-                                           query.vec().size() / reserveTune,
-                                           callback);
-            }
-        }
+    // multi-threaded
+    void accumQuery(const BlockVector<G1>& query,
+                    const std::size_t reserveTune,
+                    ThreadPool& pool,
+                    ProgressCallback* callback = nullptr)
+    {
+        const std::size_t startIndex = accumFixed(query);
+        const std::size_t numTerms = query.vec().size() - startIndex;
+
+        m_val = m_val + multiExp01(
+            query.vec(),
+            m_witness,
+            startIndex,
+            query.vec().size(),
+            0 == reserveTune ? 0 : numTerms / reserveTune,
+            pool,
+            callback);
     }
 
     const G1& val() const { return m_val; }
 
 private:
+    // the first block starts with the random_d terms and the constant
+    // term, returns the index of the first witness term
+    std::size_t accumFixed(const BlockVector<G1>& query) {
+        if (0 != query.block()[0]) return 0;
+
+#ifdef USE_ASSERT
+        assert(query.size() >= 4);
+#endif
+
+        m_val = m_val
+            + m_random_d1 * query[0]
+            + m_random_d2 * query[1]
+            + m_random_d3 * query[2]
+            + query[3];
+
+        return 4;
+    }
+
     const std::vector<Fr>& m_witness;
     const Fr& m_random_d1;
     const Fr& m_random_d2;
     const Fr& m_random_d3;
     G1 m_val;
+    MultiExpArena<G1, Fr> m_arena;
 };
 
 } // namespace snarklib
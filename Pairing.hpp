@@ -1,15 +1,19 @@
 #ifndef _SNARKLIB_PAIRING_HPP_
 #define _SNARKLIB_PAIRING_HPP_
 
+#include <algorithm>
 #include <cstdint>
 #include <gmp.h>
 #include <istream>
+#include <memory>
 #include <ostream>
 #include <vector>
 #include "AuxSTL.hpp"
 #include "BigInt.hpp"
 #include "Group.hpp"
+#include "MultiExp.hpp"
 #include "ProgressCallback.hpp"
+#include "ThreadPool.hpp"
 #include "WindowExp.hpp"
 
 namespace snarklib {
@@ -44,6 +48,10 @@ public:
         return *this == zero();
     }
 
+    Pairing dbl() const {
+        return Pairing(m_G.dbl(), m_H.dbl());
+    }
+
     static Pairing zero() {
         return Pairing<GA, GB>(GA::zero(), GB::zero());
     }
@@ -111,59 +119,122 @@ SparseVector<Pairing<GA, GB>>& batchSpecial(SparseVector<Pairing<GA, GB>>& vec)
 
 template <mp_size_t N, typename GA, typename GB>
 Pairing<GA, GB> wnafExp(const BigInt<N>& scalar,
-                        const Pairing<GA, GB>& base)
+                        const Pairing<GA, GB>& base,
+                        const std::size_t maxTableSize = 1u << 8)
 {
-    return Pairing<GA, GB>(wnafExp(scalar, base.G()),
-                           wnafExp(scalar, base.H()));
+    return Pairing<GA, GB>(wnafExp(scalar, base.G(), maxTableSize),
+                           wnafExp(scalar, base.H(), maxTableSize));
 }
 
-// standard vector, works with map-reduce or monolithic window tables
-template <typename GA, typename GB, typename FR>
-SparseVector<Pairing<GA, GB>> batchExp(const WindowExp<GA>& tableA,
-                                       const WindowExp<GB>& tableB,
-                                       const FR& coeffA,
-                                       const FR& coeffB,
-                                       const std::vector<FR>& vec,
-                                       ProgressCallback* callback = nullptr)
+// calls func(pos, pairing) for sparse vector positions [startPos, stopPos)
+// where the pairing is exp(coeffA * vec[i]) and exp(coeffB * vec[i]) at
+// index i of the position, each table walks a batch of window digits
+template <typename GA, typename GB, typename FR, typename VEC, typename FUNC>
+void batchExpWalk(const SparseVector<Pairing<GA, GB>>& res,
+                  const WindowExp<GA>& tableA,
+                  const WindowExp<GB>& tableB,
+                  const FR& coeffA,
+                  const FR& coeffB,
+                  const VEC& vec,
+                  const std::size_t startPos,
+                  const std::size_t stopPos,
+                  FUNC func)
+{
+    const std::size_t batchSize = 256;
+
+    std::vector<GA> g(std::min(batchSize, stopPos - startPos), GA::zero());
+
+    for (std::size_t pos = startPos; pos < stopPos; pos += batchSize) {
+        const std::size_t n = std::min(batchSize, stopPos - pos);
+
+        tableA.batchWalk(
+            n,
+            [&res, &coeffA, &vec, pos] (const std::size_t k) {
+                return coeffA * vec[res.getIndex(pos + k)];
+            },
+            [&g] (const std::size_t k, const GA& a) {
+                g[k] = a;
+            });
+
+        tableB.batchWalk(
+            n,
+            [&res, &coeffB, &vec, pos] (const std::size_t k) {
+                return coeffB * vec[res.getIndex(pos + k)];
+            },
+            [&g, &func, pos] (const std::size_t k, const GB& b) {
+                func(pos + k, Pairing<GA, GB>(g[k], b));
+            });
+    }
+}
+
+// sparse vector of the nonzero indices of vec[startIndex, stopIndex)
+template <typename GA, typename GB, typename VEC>
+SparseVector<Pairing<GA, GB>> nonzeroIndices(const VEC& vec,
+                                             const std::size_t startIndex,
+                                             const std::size_t stopIndex)
+{
+    std::size_t index = 0;
+    for (std::size_t i = startIndex; i < stopIndex; ++i) {
+        if (! vec[i].isZero()) ++index;
+    }
+
+    SparseVector<Pairing<GA, GB>> res(index, Pairing<GA, GB>::zero());
+
+    index = 0;
+    for (std::size_t i = startIndex; i < stopIndex; ++i) {
+        if (! vec[i].isZero()) res.setIndex(index++, i);
+    }
+
+    return res;
+}
+
+// every element of sparse vector set to the pairing, or accumulated
+template <typename GA, typename GB, typename FR, typename VEC>
+void batchExpBlocks(SparseVector<Pairing<GA, GB>>& res,
+                    const WindowExp<GA>& tableA,
+                    const WindowExp<GB>& tableB,
+                    const FR& coeffA,
+                    const FR& coeffB,
+                    const VEC& vec,
+                    const bool accum,
+                    ProgressCallback* callback)
 {
     const std::size_t M = callback ? callback->minorSteps() : 0;
-    const std::size_t N = vec.size();
+    const std::size_t N = res.size();
 
-    SparseVector<Pairing<GA, GB>> res(N, Pairing<GA, GB>::zero());
+    const auto func = [&res, accum] (const std::size_t pos,
+                                     const Pairing<GA, GB>& a) {
+        res.setElement(pos, accum ? res.getElement(pos) + a : a);
+    };
 
-    std::size_t i = 0, index = 0;
+    std::size_t index = 0;
 
     // full blocks
     for (std::size_t j = 0; j < M; ++j) {
-        for (std::size_t k = 0; k < N / M; ++k) {
-            if (! vec[i].isZero()) {
-                res.setIndexElement(
-                    index++,
-                    i,
-                    Pairing<GA, GB>(tableA.exp(coeffA * vec[i]),
-                                    tableB.exp(coeffB * vec[i])));
-            }
-
-            ++i;
-        }
+        batchExpWalk(res, tableA, tableB, coeffA, coeffB, vec,
+                     index, index + N / M, func);
+        index += N / M;
 
         callback->minor();
     }
 
     // remaining steps smaller than one block
-    while (i < N) {
-        if (! vec[i].isZero()) {
-            res.setIndexElement(
-                index++,
-                i,
-                Pairing<GA, GB>(tableA.exp(coeffA * vec[i]),
-                                tableB.exp(coeffB * vec[i])));
-        }
-
-        ++i;
-    }
+    batchExpWalk(res, tableA, tableB, coeffA, coeffB, vec,
+                 index, N, func);
+}
 
-    res.resize(index);
+// standard vector, works with map-reduce or monolithic window tables
+template <typename GA, typename GB, typename FR>
+SparseVector<Pairing<GA, GB>> batchExp(const WindowExp<GA>& tableA,
+                                       const WindowExp<GB>& tableB,
+                                       const FR& coeffA,
+                                       const FR& coeffB,
+                                       const std::vector<FR>& vec,
+                                       ProgressCallback* callback = nullptr)
+{
+    auto res = nonzeroIndices<GA, GB>(vec, 0, vec.size());
+
+    batchExpBlocks(res, tableA, tableB, coeffA, coeffB, vec, false, callback);
 
 #ifdef USE_ADD_SPECIAL
     batchSpecial(res);
@@ -181,44 +252,9 @@ SparseVector<Pairing<GA, GB>> batchExp(const WindowExp<GA>& tableA,
                                        const BlockVector<FR>& vec,
                                        ProgressCallback* callback = nullptr)
 {
-    const std::size_t M = callback ? callback->minorSteps() : 0;
-    const std::size_t N = vec.size();
-
-    SparseVector<Pairing<GA, GB>> res(vec.size(), Pairing<GA, GB>::zero());
-
-    std::size_t i = vec.startIndex(), index = 0;
+    auto res = nonzeroIndices<GA, GB>(vec, vec.startIndex(), vec.stopIndex());
 
-    // full blocks
-    for (std::size_t j = 0; j < M; ++j) {
-        for (std::size_t k = 0; k < N / M; ++k) {
-            if (! vec[i].isZero()) {
-                res.setIndexElement(
-                    index++,
-                    i,
-                    Pairing<GA, GB>(tableA.exp(coeffA * vec[i]),
-                                    tableB.exp(coeffB * vec[i])));
-            }
-
-            ++i;
-        }
-
-        callback->minor();
-    }
-
-    // remaining steps smaller than one block
-    while (i < vec.stopIndex()) {
-        if (! vec[i].isZero()) {
-            res.setIndexElement(
-                index++,
-                i,
-                Pairing<GA, GB>(tableA.exp(coeffA * vec[i]),
-                                tableB.exp(coeffB * vec[i])));
-        }
-
-        ++i;
-    }
-
-    res.resize(index);
+    batchExpBlocks(res, tableA, tableB, coeffA, coeffB, vec, false, callback);
 
 #ifdef USE_ADD_SPECIAL
     batchSpecial(res);
@@ -237,41 +273,135 @@ void batchExp(SparseVector<Pairing<GA, GB>>& res, // returned from batchExp()
               const std::vector<FR>& vec,
               ProgressCallback* callback = nullptr)
 {
-    const std::size_t M = callback ? callback->minorSteps() : 0;
-    const std::size_t N = res.size(); // iterate over sparse vector directly
+    batchExpBlocks(res, tableA, tableB, coeffA, coeffB, vec, true, callback);
+}
 
-    std::size_t index = 0;
+// block partitioned vector, used with map-reduce
+template <typename GA, typename GB, typename FR>
+void batchExp(SparseVector<Pairing<GA, GB>>& res, // returned from batchExp()
+              const WindowExp<GA>& tableA,
+              const WindowExp<GB>& tableB,
+              const FR& coeffA,
+              const FR& coeffB,
+              const BlockVector<FR>& vec,
+              ProgressCallback* callback = nullptr)
+{
+    batchExpBlocks(res, tableA, tableB, coeffA, coeffB, vec, true, callback);
+}
 
-    // full blocks
-    for (std::size_t j = 0; j < M; ++j) {
-        for (std::size_t k = 0; k < N / M; ++k) {
-            const auto i = res.getIndex(index);
-            const auto elem = res.getElement(index);
+// multi-threaded batchExp() over vec[startIndex, stopIndex)
+// nonzero positions are found first so threads write results in place
+template <typename GA, typename GB, typename FR, typename VEC>
+SparseVector<Pairing<GA, GB>> batchExpRange(const WindowExp<GA>& tableA,
+                                            const WindowExp<GB>& tableB,
+                                            const FR& coeffA,
+                                            const FR& coeffB,
+                                            const VEC& vec,
+                                            const std::size_t startIndex,
+                                            const std::size_t stopIndex,
+                                            ThreadPool& pool,
+                                            ProgressCallback* callback)
+{
+    auto res = nonzeroIndices<GA, GB>(vec, startIndex, stopIndex);
 
-            res.setIndexElement(
-                index++,
-                i,
-                elem + Pairing<GA, GB>(tableA.exp(coeffA * vec[i]),
-                                       tableB.exp(coeffB * vec[i])));
-        }
+    ProgressCounter progress(callback, res.size());
 
-        callback->minor();
-    }
+    pool.blockPartition(
+        res.size(),
+        [&] (const std::size_t,
+             const std::size_t a,
+             const std::size_t b) {
+            batchExpWalk(res, tableA, tableB, coeffA, coeffB, vec, a, b,
+                         [&res, &progress] (const std::size_t pos,
+                                            const Pairing<GA, GB>& x) {
+                             res.setElement(pos, x);
+                             progress.step();
+                         });
+        });
 
-    // remaining steps smaller than one block
-    while (index < N) {
-        const auto i = res.getIndex(index);
-        const auto elem = res.getElement(index);
-
-        res.setIndexElement(
-            index++,
-            i,
-            elem + Pairing<GA, GB>(tableA.exp(coeffA * vec[i]),
-                                   tableB.exp(coeffB * vec[i])));
-    }
+    progress.finish();
+
+#ifdef USE_ADD_SPECIAL
+    batchSpecial(res);
+#endif
+
+    return res;
 }
 
-// block partitioned vector, used with map-reduce
+// multi-threaded, standard vector
+template <typename GA, typename GB, typename FR>
+SparseVector<Pairing<GA, GB>> batchExp(const WindowExp<GA>& tableA,
+                                       const WindowExp<GB>& tableB,
+                                       const FR& coeffA,
+                                       const FR& coeffB,
+                                       const std::vector<FR>& vec,
+                                       ThreadPool& pool,
+                                       ProgressCallback* callback = nullptr)
+{
+    return batchExpRange(tableA, tableB, coeffA, coeffB,
+                         vec, 0, vec.size(),
+                         pool, callback);
+}
+
+// multi-threaded, block partitioned vector
+template <typename GA, typename GB, typename FR>
+SparseVector<Pairing<GA, GB>> batchExp(const WindowExp<GA>& tableA,
+                                       const WindowExp<GB>& tableB,
+                                       const FR& coeffA,
+                                       const FR& coeffB,
+                                       const BlockVector<FR>& vec,
+                                       ThreadPool& pool,
+                                       ProgressCallback* callback = nullptr)
+{
+    return batchExpRange(tableA, tableB, coeffA, coeffB,
+                         vec, vec.startIndex(), vec.stopIndex(),
+                         pool, callback);
+}
+
+// multi-threaded, accumulate into sparse vector returned from batchExp()
+template <typename GA, typename GB, typename FR, typename VEC>
+void batchExpAccum(SparseVector<Pairing<GA, GB>>& res,
+                   const WindowExp<GA>& tableA,
+                   const WindowExp<GB>& tableB,
+                   const FR& coeffA,
+                   const FR& coeffB,
+                   const VEC& vec,
+                   ThreadPool& pool,
+                   ProgressCallback* callback)
+{
+    ProgressCounter progress(callback, res.size());
+
+    pool.blockPartition(
+        res.size(),
+        [&] (const std::size_t,
+             const std::size_t a,
+             const std::size_t b) {
+            batchExpWalk(res, tableA, tableB, coeffA, coeffB, vec, a, b,
+                         [&res, &progress] (const std::size_t pos,
+                                            const Pairing<GA, GB>& x) {
+                             res.setElement(pos, res.getElement(pos) + x);
+                             progress.step();
+                         });
+        });
+
+    progress.finish();
+}
+
+// multi-threaded, used with map-reduce
+template <typename GA, typename GB, typename FR>
+void batchExp(SparseVector<Pairing<GA, GB>>& res, // returned from batchExp()
+              const WindowExp<GA>& tableA,
+              const WindowExp<GB>& tableB,
+              const FR& coeffA,
+              const FR& coeffB,
+              const std::vector<FR>& vec,
+              ThreadPool& pool,
+              ProgressCallback* callback = nullptr)
+{
+    batchExpAccum(res, tableA, tableB, coeffA, coeffB, vec, pool, callback);
+}
+
+// multi-threaded, block partitioned vector, used with map-reduce
 template <typename GA, typename GB, typename FR>
 void batchExp(SparseVector<Pairing<GA, GB>>& res, // returned from batchExp()
               const WindowExp<GA>& tableA,
@@ -279,40 +409,69 @@ void batchExp(SparseVector<Pairing<GA, GB>>& res, // returned from batchExp()
               const FR& coeffA,
               const FR& coeffB,
               const BlockVector<FR>& vec,
+              ThreadPool& pool,
               ProgressCallback* callback = nullptr)
 {
-    const std::size_t M = callback ? callback->minorSteps() : 0;
-    const std::size_t N = res.size(); // iterate over sparse vector directly
+    batchExpAccum(res, tableA, tableB, coeffA, coeffB, vec, pool, callback);
+}
 
-    std::size_t index = 0;
+// positions [startPos, stopPos) of sparse vector with indices in
+// [minIndex, maxIndex), the sparse vector indices are in order
+template <typename T>
+void sparseRange(const SparseVector<T>& vec,
+                 const std::size_t minIndex,
+                 const std::size_t maxIndex,
+                 std::size_t& startPos,
+                 std::size_t& stopPos)
+{
+    startPos = 0;
+    while (startPos < vec.size() && vec.getIndex(startPos) < minIndex)
+        ++startPos;
 
-    // full blocks
-    for (std::size_t j = 0; j < M; ++j) {
-        for (std::size_t k = 0; k < N / M; ++k) {
-            const auto i = res.getIndex(index);
-            const auto elem = res.getElement(index);
+    stopPos = startPos;
+    while (stopPos < vec.size() && vec.getIndex(stopPos) < maxIndex)
+        ++stopPos;
+}
 
-            res.setIndexElement(
-                index++,
-                i,
-                elem + Pairing<GA, GB>(tableA.exp(coeffA * vec[i]),
-                                       tableB.exp(coeffB * vec[i])));
-        }
+// sparse vector positions [startPos, stopPos) without copying
+template <typename GA, typename GB, typename FR>
+Pairing<GA, GB> multiExp01Range(const SparseVector<Pairing<GA, GB>>& base,
+                                const std::vector<FR>& scalar,
+                                const std::size_t minIndex,
+                                const std::size_t startPos,
+                                const std::size_t stopPos,
+                                const std::size_t reserveCount, // for performance tuning
+                                MultiExpArena<Pairing<GA, GB>, FR>& arena,
+                                ProgressCallback* callback)
+{
+    return multiExp01View(
+        stopPos - startPos,
+        [&base, startPos] (const std::size_t i) -> const Pairing<GA, GB>& {
+            return base.getElement(startPos + i);
+        },
+        [&base, &scalar, minIndex, startPos] (const std::size_t i) -> const FR& {
+            return scalar[base.getIndex(startPos + i) - minIndex];
+        },
+        reserveCount,
+        arena,
+        callback);
+}
 
-        callback->minor();
-    }
+// scratch memory in arena is reused by each call
+template <typename GA, typename GB, typename FR>
+Pairing<GA, GB> multiExp01(const SparseVector<Pairing<GA, GB>>& base,
+                           const std::vector<FR>& scalar,
+                           const std::size_t minIndex,
+                           const std::size_t maxIndex,
+                           const std::size_t reserveCount, // for performance tuning
+                           MultiExpArena<Pairing<GA, GB>, FR>& arena,
+                           ProgressCallback* callback = nullptr)
+{
+    std::size_t startPos, stopPos;
+    sparseRange(base, minIndex, maxIndex, startPos, stopPos);
 
-    // remaining steps smaller than one block
-    while (index < N) {
-        const auto i = res.getIndex(index);
-        const auto elem = res.getElement(index);
-
-        res.setIndexElement(
-            index++,
-            i,
-            elem + Pairing<GA, GB>(tableA.exp(coeffA * vec[i]),
-                                   tableB.exp(coeffB * vec[i])));
-    }
+    return multiExp01Range(base, scalar, minIndex, startPos, stopPos,
+                           reserveCount, arena, callback);
 }
 
 template <typename GA, typename GB, typename FR>
@@ -323,46 +482,9 @@ Pairing<GA, GB> multiExp01(const SparseVector<Pairing<GA, GB>>& base,
                            const std::size_t reserveCount, // for performance tuning
                            ProgressCallback* callback)
 {
-    const auto
-        ZERO = FR::zero(),
-        ONE = FR::one();
-
-    std::vector<Pairing<GA, GB>> base2;
-    std::vector<FR> scalar2;
-    if (reserveCount) {
-        base2.reserve(reserveCount);
-        scalar2.reserve(reserveCount);
-    }
-
-    auto accum = Pairing<GA, GB>::zero();
-
-    for (std::size_t i = 0; i < base.size(); ++i) {
-        const auto idx = base.getIndex(i);
+    MultiExpArena<Pairing<GA, GB>, FR> arena;
 
-        if (idx >= maxIndex) {
-            break;
-
-        } else if (idx >= minIndex) {
-            const auto a = scalar[idx - minIndex];
-
-            if (ZERO == a) {
-                continue;
-
-            } else if (ONE == a) {
-#ifdef USE_ADD_SPECIAL
-                accum = fastAddSpecial(accum, base.getElement(i));
-#else
-                accum = accum + base.getElement(i);
-#endif
-
-            } else {
-                base2.emplace_back(base.getElement(i));
-                scalar2.emplace_back(a);
-            }
-        }
-    }
-
-    return accum + multiExp(base2, scalar2, callback);
+    return multiExp01(base, scalar, minIndex, maxIndex, reserveCount, arena, callback);
 }
 
 template <typename GA, typename GB, typename FR>
@@ -375,6 +497,54 @@ Pairing<GA, GB> multiExp01(const SparseVector<Pairing<GA, GB>>& base,
     return multiExp01(base, scalar, minIndex, maxIndex, 0, callback);
 }
 
+// multi-threaded, partial sums are added in block order
+template <typename GA, typename GB, typename FR>
+Pairing<GA, GB> multiExp01(const SparseVector<Pairing<GA, GB>>& base,
+                           const std::vector<FR>& scalar,
+                           const std::size_t minIndex,
+                           const std::size_t maxIndex,
+                           const std::size_t reserveCount, // for performance tuning
+                           ThreadPool& pool,
+                           ProgressCallback* callback = nullptr)
+{
+    std::size_t startPos, stopPos;
+    sparseRange(base, minIndex, maxIndex, startPos, stopPos);
+
+    // only positions inside the index range are partitioned
+    const std::size_t numBlocks = std::min(stopPos - startPos, pool.numThreads());
+
+    if (numBlocks <= 1) {
+        MultiExpArena<Pairing<GA, GB>, FR> arena;
+
+        return multiExp01Range(base, scalar, minIndex, startPos, stopPos,
+                               reserveCount, arena, callback);
+    }
+
+    ProgressCallback_Blocks blockCB(callback, numBlocks);
+    ProgressCallback* cb = callback ? std::addressof(blockCB) : nullptr;
+
+    std::vector<Pairing<GA, GB>> partialSum(numBlocks, Pairing<GA, GB>::zero());
+
+    pool.blockPartition(
+        stopPos - startPos,
+        [&] (const std::size_t block,
+             const std::size_t a,
+             const std::size_t b) {
+            MultiExpArena<Pairing<GA, GB>, FR> arena;
+
+            partialSum[block] = multiExp01Range(base, scalar, minIndex,
+                                                startPos + a, startPos + b,
+                                                reserveCount / numBlocks, arena, cb);
+        });
+
+    auto res = Pairing<GA, GB>::zero();
+    for (const auto& a : partialSum) {
+        res = res + a;
+    }
+
+    return res;
+}
+
 } // namespace snarklib
 
 #endif
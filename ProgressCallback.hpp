@@ -1,7 +1,9 @@
 #ifndef _SNARKLIB_PROGRESS_CALLBACK_HPP_
 #define _SNARKLIB_PROGRESS_CALLBACK_HPP_
 
+#include <atomic>
 #include <cstdint>
+#include <mutex>
 
 namespace snarklib {
 
@@ -39,6 +41,96 @@ public:
     void minor() {}
 };
 
+// minor callbacks from concurrent blocks of work
+// Each block reports all minor steps of the wrapped callback. Every
+// numberBlocks of these become one minor step of the wrapped callback.
+class ProgressCallback_Blocks : public ProgressCallback
+{
+public:
+    ProgressCallback_Blocks(ProgressCallback* callback,
+                            const std::size_t numberBlocks)
+        : m_callback(callback),
+          m_numberBlocks(numberBlocks),
+          m_count(0)
+    {}
+
+    void majorSteps(const std::size_t) {}
+    void major(const bool newLine) {}
+
+    std::size_t minorSteps() {
+        return m_callback ? m_callback->minorSteps() : 0;
+    }
+
+    void minor() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_numberBlocks == ++m_count) {
+            m_count = 0;
+            m_callback->minor();
+        }
+    }
+
+private:
+    ProgressCallback* m_callback;
+    const std::size_t m_numberBlocks;
+    std::size_t m_count;
+    std::mutex m_mutex;
+};
+
+// minor callbacks from a shared count of finished work items
+// Threads call step() after each item, the wrapped callback sees its
+// minor steps spread evenly over all items.
+class ProgressCounter
+{
+public:
+    ProgressCounter(ProgressCallback* callback,
+                    const std::size_t numberItems)
+        : m_callback(callback),
+          m_minorSteps(callback ? callback->minorSteps() : 0),
+          m_numberItems(numberItems),
+          m_count(0),
+          m_minorCount(0)
+    {}
+
+    // thread safe
+    void step() {
+        if (0 == m_minorSteps) return;
+
+        const std::size_t n = ++m_count;
+
+        if ((n * m_minorSteps) / m_numberItems !=
+            ((n - 1) * m_minorSteps) / m_numberItems)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            const std::size_t target
+                = (m_count.load() * m_minorSteps) / m_numberItems;
+
+            while (m_minorCount < target) {
+                ++m_minorCount;
+                m_callback->minor();
+            }
+        }
+    }
+
+    // final callbacks
+    void finish() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        while (m_minorCount < m_minorSteps) {
+            ++m_minorCount;
+            m_callback->minor();
+        }
+    }
+
+private:
+    ProgressCallback* m_callback;
+    const std::size_t m_minorSteps, m_numberItems;
+    std::atomic<std::size_t> m_count;
+    std::size_t m_minorCount;
+    std::mutex m_mutex;
+};
+
 } // namespace snarklib
 
 #endif
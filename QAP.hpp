@@ -1,14 +1,18 @@
 #ifndef _SNARKLIB_QAP_HPP_
 #define _SNARKLIB_QAP_HPP_
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cstdint>
+#include <memory>
+#include <utility>
 #include <vector>
 #include "LagrangeFFT.hpp"
 #include "LagrangeFFTX.hpp"
 #include "ProgressCallback.hpp"
 #include "Rank1DSL.hpp"
+#include "ThreadPool.hpp"
 
 namespace snarklib {
 
@@ -98,37 +102,108 @@ public:
         : m_nonzeroCount(0),
           m_vec(3 + qap.numVariables() + 1, T::zero())
     {
+        inputConsistency(qap);
+
+        accumConstraints(qap, m_vec);
+
+        countNonzero();
+    }
+
+    // multi-threaded, same result as single-threaded
+    // (terms are grouped by variable and each thread adds into its own
+    // range of variables, no per-thread copies of the query vector)
+    QAP_QueryABC(const QAP_SystemPoint<T>& qap,
+                 ThreadPool& pool)
+        : m_nonzeroCount(0),
+          m_vec(3 + qap.numVariables() + 1, T::zero())
+    {
+        inputConsistency(qap);
+
+        const auto& constraints = qap.constraintSystem().constraints();
+        const std::size_t numVars = m_vec.size() - 3;
+
+        // terms of variable v are entries [offset[v], offset[v + 1])
+        std::vector<std::size_t> offset(numVars + 1, 0);
+
+        for (const auto& c : constraints) {
+            for (const auto& term : c.combo(R1C).terms())
+                ++offset[term.index() + 1];
+        }
+
+        for (std::size_t v = 0; v < numVars; ++v)
+            offset[v + 1] += offset[v];
+
+        // constraint index and coefficient of each term
+        std::vector<std::pair<std::size_t, const T*>> entries(offset.back());
+        std::vector<std::size_t> next(offset.begin(), offset.end() - 1);
+
+        for (std::size_t i = 0; i < constraints.size(); ++i) {
+            for (const auto& term : constraints[i].combo(R1C).terms())
+                entries[next[term.index()]++] = std::make_pair(i, std::addressof(term.coeff()));
+        }
+
+        // blocks of entries, a variable belongs to the block with its
+        // first entry
+        pool.blockPartition(
+            entries.size(),
+            [this, &qap, &offset, &entries] (const std::size_t,
+                                             const std::size_t startIndex,
+                                             const std::size_t stopIndex) {
+                const auto& lagrange = qap.lagrange_coeffs();
+
+                const std::size_t
+                    startVar = std::lower_bound(offset.begin(), offset.end() - 1, startIndex) - offset.begin(),
+                    stopVar = std::lower_bound(offset.begin(), offset.end() - 1, stopIndex) - offset.begin();
+
+                for (std::size_t v = startVar; v < stopVar; ++v) {
+                    for (std::size_t j = offset[v]; j < offset[v + 1]; ++j)
+                        m_vec[3 + v] += lagrange[entries[j].first + 1] * (*entries[j].second);
+                }
+            });
+
+        countNonzero();
+    }
+
+    std::size_t nonzeroCount() const { return m_nonzeroCount; }
+    const std::vector<T>& vec() const { return m_vec; }
+
+    // only used by QAP_QueryIC<T>
+    void zeroElement(const std::size_t index) {
+        m_vec[index] = T::zero();
+    }
+
+private:
+    void inputConsistency(const QAP_SystemPoint<T>& qap) {
         m_vec[Z_INDEX] = qap.compute_Z();
-        auto uit = qap.lagrange_coeffs().begin();
 
         // input consistency
         switch (R1C) {
         case ('a') :
         case ('A') :
             for (std::size_t i = 0; i <= qap.numCircuitInputs(); ++i)
-                m_vec[3 + i] = (*uit) * T(i + 1);
+                m_vec[3 + i] = qap.lagrange_coeffs()[0] * T(i + 1);
         }
+    }
+
+    // all constraints added into vec
+    static void accumConstraints(const QAP_SystemPoint<T>& qap,
+                                 std::vector<T>& vec)
+    {
+        auto uit = qap.lagrange_coeffs().begin();
 
         for (const auto& constraint : qap.constraintSystem().constraints()) {
             ++uit;
 
             for (const auto& term : constraint.combo(R1C).terms())
-                m_vec[3 + term.index()] += (*uit) * term.coeff();
+                vec[3 + term.index()] += (*uit) * term.coeff();
         }
+    }
 
+    void countNonzero() {
         for (const auto& v : m_vec)
             if (! v.isZero()) ++m_nonzeroCount;
     }
 
-    std::size_t nonzeroCount() const { return m_nonzeroCount; }
-    const std::vector<T>& vec() const { return m_vec; }
-
-    // only used by QAP_QueryIC<T>
-    void zeroElement(const std::size_t index) {
-        m_vec[index] = T::zero();
-    }
-
-private:
     std::size_t m_nonzeroCount;
     std::vector<T> m_vec;
 };
@@ -149,21 +224,49 @@ public:
         : m_nonzeroCount(0),
           m_vec(qap.degree() + 1, T::zero())
     {
-        auto ti = T::one();
-
-        for (auto& r : m_vec) {
-            r = ti;
-            ti *= qap.point();
-        }
+        powers(qap.point(), 0, m_vec.size());
+        countNonzero();
+    }
 
-        for (const auto& v : m_vec)
-            if (! v.isZero()) ++m_nonzeroCount;
+    // multi-threaded, same result as single-threaded
+    // (each block starts from its own power of the point)
+    QAP_QueryH(const QAP_SystemPoint<T>& qap,
+               ThreadPool& pool)
+        : m_nonzeroCount(0),
+          m_vec(qap.degree() + 1, T::zero())
+    {
+        pool.blockPartition(
+            m_vec.size(),
+            [this, &qap] (const std::size_t,
+                          const std::size_t startIndex,
+                          const std::size_t stopIndex) {
+                powers(qap.point(), startIndex, stopIndex);
+            });
+
+        countNonzero();
     }
 
     std::size_t nonzeroCount() const { return m_nonzeroCount; }
     const std::vector<T>& vec() const { return m_vec; }
 
 private:
+    void powers(const T& point,
+                const std::size_t startIndex,
+                const std::size_t stopIndex)
+    {
+        auto ti = (0 == startIndex) ? T::one() : point ^ startIndex;
+
+        for (std::size_t i = startIndex; i < stopIndex; ++i) {
+            m_vec[i] = ti;
+            ti *= point;
+        }
+    }
+
+    void countNonzero() {
+        for (const auto& v : m_vec)
+            if (! v.isZero()) ++m_nonzeroCount;
+    }
+
     std::size_t m_nonzeroCount;
     std::vector<T> m_vec;
 };
@@ -235,19 +338,52 @@ public:
                const T& random_B,
                const T& random_beta)
         : m_vec(3 + qap.numVariables() + 1, T::zero())
+    {
+        accum(At, Bt, Ct, random_A, random_B, random_beta, 0, m_vec.size());
+    }
+
+    // multi-threaded, same result as single-threaded
+    QAP_QueryK(const QAP_SystemPoint<T>& qap,
+               const QAP_QueryA<T>& At,
+               const QAP_QueryB<T>& Bt,
+               const QAP_QueryC<T>& Ct,
+               const T& random_A,
+               const T& random_B,
+               const T& random_beta,
+               ThreadPool& pool)
+        : m_vec(3 + qap.numVariables() + 1, T::zero())
+    {
+        pool.blockPartition(
+            m_vec.size(),
+            [&] (const std::size_t,
+                 const std::size_t startIndex,
+                 const std::size_t stopIndex) {
+                accum(At, Bt, Ct, random_A, random_B, random_beta,
+                      startIndex, stopIndex);
+            });
+    }
+
+    const std::vector<T>& vec() const { return m_vec; }
+
+private:
+    void accum(const QAP_QueryA<T>& At,
+               const QAP_QueryB<T>& Bt,
+               const QAP_QueryC<T>& Ct,
+               const T& random_A,
+               const T& random_B,
+               const T& random_beta,
+               const std::size_t startIndex,
+               const std::size_t stopIndex)
     {
         const auto random_C = random_A * random_B;
 
-        for (std::size_t i = 0; i < m_vec.size(); ++i) {
+        for (std::size_t i = startIndex; i < stopIndex; ++i) {
             m_vec[i] = random_beta * (random_A * At.vec()[i]
                                       + random_B * Bt.vec()[i]
                                       + random_C * Ct.vec()[i]);
         }
     }
 
-    const std::vector<T>& vec() const { return m_vec; }
-
-private:
     std::vector<T> m_vec;
 };
 
@@ -264,33 +400,63 @@ public:
         : m_qap(qap),
           m_vec(qap.degree(), T::zero())
     {
-        auto uit = m_vec.begin();
+        fill(witness);
+        qap.FFT()->iFFT(m_vec);
+    }
+
+    // zero vector is added to the batch, fillWitnessABC() fills A, B
+    // and C together before the caller does the iFFT (and cosetFFT) of
+    // the batch in one pass
+    QAP_WitnessABC(const QAP_SystemPoint<T>& qap,
+                   std::vector<std::vector<T>*>& batchFFT)
+        : m_qap(qap),
+          m_vec(qap.degree(), T::zero())
+    {
+        batchFFT.push_back(std::addressof(m_vec));
+    }
+
+    void cosetFFT() {
+        m_qap.FFT()->cosetFFT(m_vec, T::params.multiplicative_generator());
+    }
+
+    const std::vector<T>& vec() const { return m_vec; }
+    std::vector<T>& vec() { return m_vec; }
+
+    // frees the vector storage
+    void clear() {
+        std::vector<T>().swap(m_vec);
+    }
+
+    // first element, zero except for A
+    static T inputConsistency(const QAP_SystemPoint<T>& qap,
+                              const R1Witness<T>& witness)
+    {
+        T u = T::zero();
 
-        // input consistency
         switch (R1C) {
         case ('a') :
         case ('A') :
-            *uit = T::one();
+            u = T::one();
             for (std::size_t i = 0; i < qap.numCircuitInputs(); ++i) {
-                *uit += witness[i] * T(i + 2);
+                u += witness[i] * T(i + 2);
             }
         }
 
-        for (const auto& constraint : qap.constraintSystem().constraints()) {
-            ++uit;
-            *uit += constraint.combo(R1C) * witness;
-        }
-
-        qap.FFT()->iFFT(m_vec);
+        return u;
     }
 
-    void cosetFFT() {
-        m_qap.FFT()->cosetFFT(m_vec, T::params.multiplicative_generator());
-    }
+private:
+    void fill(const R1Witness<T>& witness) {
+        auto uit = m_vec.begin();
 
-    const std::vector<T>& vec() const { return m_vec; }
+        *uit = inputConsistency(m_qap, witness);
+
+        for (const auto& constraint : m_qap.constraintSystem().constraints()) {
+            ++uit;
+            *uit = constraint.combo(R1C) * witness;
+        }
+    }
 
-private:
     const QAP_SystemPoint<T>& m_qap;
     std::vector<T> m_vec;
 };
@@ -299,6 +465,67 @@ template <typename T> using QAP_WitnessA = QAP_WitnessABC<T, 'A'>;
 template <typename T> using QAP_WitnessB = QAP_WitnessABC<T, 'B'>;
 template <typename T> using QAP_WitnessC = QAP_WitnessABC<T, 'C'>;
 
+////////////////////////////////////////////////////////////////////////////////
+// witness vectors A, B, C filled together
+//
+
+// constraints [startIndex, stopIndex), each is read once for A, B, C
+template <typename T>
+void fillWitnessABC(const QAP_SystemPoint<T>& qap,
+                    const R1Witness<T>& witness,
+                    QAP_WitnessA<T>& aA,
+                    QAP_WitnessB<T>& aB,
+                    QAP_WitnessC<T>& aC,
+                    const std::size_t startIndex,
+                    const std::size_t stopIndex)
+{
+    const auto& constraints = qap.constraintSystem().constraints();
+
+    auto& A = aA.vec();
+    auto& B = aB.vec();
+    auto& C = aC.vec();
+
+    for (std::size_t i = startIndex; i < stopIndex; ++i) {
+        const auto& constraint = constraints[i];
+        A[i + 1] = constraint.a() * witness;
+        B[i + 1] = constraint.b() * witness;
+        C[i + 1] = constraint.c() * witness;
+    }
+}
+
+template <typename T>
+void fillWitnessABC(const QAP_SystemPoint<T>& qap,
+                    const R1Witness<T>& witness,
+                    QAP_WitnessA<T>& aA,
+                    QAP_WitnessB<T>& aB,
+                    QAP_WitnessC<T>& aC)
+{
+    aA.vec()[0] = QAP_WitnessA<T>::inputConsistency(qap, witness);
+
+    fillWitnessABC(qap, witness, aA, aB, aC,
+                   0, qap.constraintSystem().constraints().size());
+}
+
+// multi-threaded, same result as single-threaded
+template <typename T>
+void fillWitnessABC(const QAP_SystemPoint<T>& qap,
+                    const R1Witness<T>& witness,
+                    QAP_WitnessA<T>& aA,
+                    QAP_WitnessB<T>& aB,
+                    QAP_WitnessC<T>& aC,
+                    ThreadPool& pool)
+{
+    aA.vec()[0] = QAP_WitnessA<T>::inputConsistency(qap, witness);
+
+    pool.blockPartition(
+        qap.constraintSystem().constraints().size(),
+        [&] (const std::size_t,
+             const std::size_t startIndex,
+             const std::size_t stopIndex) {
+            fillWitnessABC(qap, witness, aA, aB, aC, startIndex, stopIndex);
+        });
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // witness vector H
 //
@@ -307,44 +534,47 @@ template <typename T>
 class QAP_WitnessH
 {
 public:
-    // regular H
+    // A, B, C are consumed and H takes the storage of A. The regular H
+    // term d2*A + d1*B - d3 is added in coset form to the quotient
+    // (A*B - C) / Z, the d1*d2*Z term is added to the coefficients.
     QAP_WitnessH(const QAP_SystemPoint<T>& qap,
-                 const QAP_WitnessA<T>& aA, // before cosetFFT()
-                 const QAP_WitnessB<T>& aB, // before cosetFFT()
+                 QAP_WitnessA<T>& aA, // after cosetFFT()
+                 QAP_WitnessB<T>& aB, // after cosetFFT()
+                 QAP_WitnessC<T>& aC, // after cosetFFT()
                  const T& random_d1,
                  const T& random_d2,
                  const T& random_d3)
-        : m_vec(qap.degree() + 1, T::zero())
     {
-        for (std::size_t i = 0; i < qap.degree(); ++i)
-            m_vec[i] = random_d2 * aA.vec()[i] + random_d1 * aB.vec()[i];
+        auto& A = aA.vec();
+        const auto& B = aB.vec();
+        auto& C = aC.vec();
 
-        m_vec[0] -= random_d3;
-        qap.FFT()->add_poly_Z(random_d1 * random_d2, m_vec);
-    }
+#ifdef USE_ASSERT
+        assert(A.size() == qap.degree());
+        assert(A.size() == B.size() && A.size() == C.size());
+#endif
 
-    // temporary H
-    QAP_WitnessH(const QAP_SystemPoint<T>& qap,
-                 const QAP_WitnessA<T>& aA, // after cosetFFT()
-                 const QAP_WitnessB<T>& aB, // after cosetFFT()
-                 const QAP_WitnessC<T>& aC) // after cosetFFT()
-        : m_vec(qap.degree(), T::zero())
-    {
-        for (std::size_t i = 0; i < m_vec.size(); ++i)
-            m_vec[i] = aA.vec()[i] * aB.vec()[i] - aC.vec()[i];
+        // temporary H in A, regular H in C
+        for (std::size_t i = 0; i < A.size(); ++i) {
+            const auto a = A[i];
+            A[i] = a * B[i] - C[i];
+            C[i] = random_d2 * a + random_d1 * B[i] - random_d3;
+        }
 
-        qap.FFT()->divide_by_Z_on_coset(m_vec);
-        qap.FFT()->icosetFFT(m_vec, T::params.multiplicative_generator());
-    }
+        aB.clear();
 
-    void addTemporary(const QAP_WitnessH& tmpH) {
-        // make sure to add temporary H, not regular H
-#ifdef USE_ASSERT
-        assert(tmpH.vec().size() < m_vec.size());
-#endif
+        qap.FFT()->divide_by_Z_on_coset(A);
+        batchAdd(A, C);
 
-        for (std::size_t i = 0; i < tmpH.vec().size(); ++i)
-            m_vec[i] += tmpH.vec()[i];
+        aC.clear();
+
+        qap.FFT()->icosetFFT(A, T::params.multiplicative_generator());
+
+        m_vec.swap(A);
+        aA.clear();
+
+        m_vec.resize(qap.degree() + 1, T::zero());
+        qap.FFT()->add_poly_Z(random_d1 * random_d2, m_vec);
     }
 
     const std::vector<T>& vec() const { return m_vec; }
@@ -0,0 +1,222 @@
+#ifndef _SNARKLIB_THREAD_POOL_HPP_
+#define _SNARKLIB_THREAD_POOL_HPP_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "IndexSpace.hpp"
+
+namespace snarklib {
+
+////////////////////////////////////////////////////////////////////////////////
+// Fork-join thread pool
+//
+// Worker threads are started once and reused. Each call to run()
+// blocks until every block of work is done. The calling thread also
+// does work so a pool of one thread has no workers at all.
+//
+
+class ThreadPool
+{
+public:
+    // zero means one thread for each hardware core
+    explicit ThreadPool(const std::size_t numThreads = 0)
+        : m_numThreads(numThreads ? numThreads : hardwareThreads()),
+          m_job(nullptr),
+          m_generation(0),
+          m_active(0),
+          m_shutdown(false)
+    {
+        for (std::size_t i = 1; i < m_numThreads; ++i) {
+            m_workers.emplace_back(&ThreadPool::workerLoop, this);
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator= (const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_shutdown = true;
+        }
+
+        m_workCV.notify_all();
+
+        for (auto& t : m_workers)
+            t.join();
+    }
+
+    static std::size_t hardwareThreads() {
+        const std::size_t n = std::thread::hardware_concurrency();
+        return n ? n : 1;
+    }
+
+    std::size_t numThreads() const {
+        return m_numThreads;
+    }
+
+    // calls func(block) for every block, returns when all are done
+    // (not reentrant, func must not call run() on the same pool)
+    // if func throws, blocks not yet started are skipped and the first
+    // exception is rethrown after every thread has left the job
+    void run(const std::size_t numBlocks,
+             const std::function<void (std::size_t)>& func)
+    {
+        if (1 >= numBlocks || m_workers.empty()) {
+            for (std::size_t i = 0; i < numBlocks; ++i)
+                func(i);
+
+            return;
+        }
+
+        std::lock_guard<std::mutex> runLock(m_runMutex);
+
+        Job job(func, numBlocks);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_job = std::addressof(job);
+            ++m_generation;
+        }
+
+        m_workCV.notify_all();
+
+        finish(job, doBlocks(job));
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_doneCV.wait(lock, [this, &job] {
+                    return 0 == job.remaining && 0 == m_active;
+                });
+
+            m_job = nullptr;
+        }
+
+        if (job.error) std::rethrow_exception(job.error);
+    }
+
+    // calls func(block, startIndex, stopIndex) for a partition of
+    // [0, N) into at most one block per thread
+    template <typename FUNC>
+    void blockPartition(const std::size_t N, FUNC func) {
+        const std::size_t numBlocks = std::min(N, m_numThreads);
+        if (0 == numBlocks) return;
+
+        IndexSpace<1> space(N);
+        space.blockPartition(std::array<std::size_t, 1>{ numBlocks });
+
+        run(numBlocks,
+            [&space, &func] (const std::size_t block) {
+                const std::array<std::size_t, 1> b{ block };
+                const std::size_t
+                    startIndex = space.indexOffset(b)[0],
+                    stopIndex = startIndex + space.indexSize(b)[0];
+
+                func(block, startIndex, stopIndex);
+            });
+    }
+
+private:
+    // one call to run(), lives on the stack of the calling thread
+    struct Job
+    {
+        Job(const std::function<void (std::size_t)>& f,
+            const std::size_t n)
+            : func(f),
+              numBlocks(n),
+              nextBlock(0),
+              failed(false),
+              remaining(n)
+        {}
+
+        const std::function<void (std::size_t)>& func;
+        const std::size_t numBlocks;
+        std::atomic<std::size_t> nextBlock;
+        std::atomic<bool> failed;
+        std::size_t remaining; // guarded by m_mutex
+        std::exception_ptr error; // guarded by m_mutex
+    };
+
+    // never throws, the first exception from func is kept in the job
+    std::size_t doBlocks(Job& job) {
+        std::size_t finished = 0;
+
+        while (true) {
+            const std::size_t block = job.nextBlock++;
+            if (block >= job.numBlocks) break;
+
+            if (! job.failed) {
+                try {
+                    job.func(block);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (! job.error) job.error = std::current_exception();
+                    job.failed = true;
+                }
+            }
+
+            ++finished;
+        }
+
+        return finished;
+    }
+
+    void finish(Job& job, const std::size_t finished) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        job.remaining -= finished;
+        if (0 == job.remaining) m_doneCV.notify_all();
+    }
+
+    void workerLoop() {
+        std::size_t generation = 0;
+
+        while (true) {
+            Job* job = nullptr;
+
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_workCV.wait(lock, [this, generation] {
+                        return m_shutdown || generation != m_generation;
+                    });
+
+                if (m_shutdown) return;
+
+                generation = m_generation;
+                job = m_job;
+                if (! job) continue; // woke up too late
+
+                ++m_active;
+            }
+
+            const std::size_t finished = doBlocks(*job);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            job->remaining -= finished;
+            --m_active;
+            if (0 == job->remaining && 0 == m_active) m_doneCV.notify_all();
+        }
+    }
+
+    const std::size_t m_numThreads;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_runMutex, m_mutex;
+    std::condition_variable m_workCV, m_doneCV;
+
+    Job* m_job;
+    std::size_t m_generation, m_active;
+    bool m_shutdown;
+};
+
+} // namespace snarklib
+
+#endif
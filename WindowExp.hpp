@@ -1,27 +1,42 @@
 #ifndef _SNARKLIB_WINDOW_EXP_HPP_
 #define _SNARKLIB_WINDOW_EXP_HPP_
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstdint>
 #include <gmp.h>
+#include <memory>
 #include <vector>
 #include "AuxSTL.hpp"
 #include "BigInt.hpp"
 #include "Group.hpp"
 #include "IndexSpace.hpp"
 #include "ProgressCallback.hpp"
+#include "ThreadPool.hpp"
 
 namespace snarklib {
 
 ////////////////////////////////////////////////////////////////////////////////
 // Window table made from powers of group generator
 //
+// Signed-digit tables (optional) recode the exponent so each window
+// digit is in (-2^(windowBits-1), 2^(windowBits-1)]. Rows then hold
+// only the positive multiples and negative digits are subtracted.
+// This is half the memory for the same window size.
+//
 
 template <typename GROUP>
 class WindowExp
 {
     typedef typename GROUP::ScalarField Fr;
 
+    // window digits fit in 32 bits, there are at most as many rows as
+    // exponent bits plus one for a signed digit carry
+    typedef std::int32_t Digit;
+    static constexpr std::size_t MAX_ROWS
+        = Fr::BaseType::numberLimbs() * GMP_NUMB_BITS + 1;
+
 public:
     // public for direct testing with libsnark::get_exp_window_size()
     static std::size_t windowBits(const std::size_t expCount) {
@@ -36,11 +51,13 @@ public:
     }
 
     // one-dimensional index space over windows (rows)
-    static IndexSpace<1> space(const std::size_t expCount) {
+    static IndexSpace<1> space(const std::size_t expCount,
+                               const bool signedDigits = false) {
         const auto wb = windowBits(expCount);
 
-        IndexSpace<1> a(numWindows(wb));
+        IndexSpace<1> a(numWindows(wb, signedDigits));
         a.param(wb);
+        if (signedDigits) a.param(1);
 
         return a;
     }
@@ -53,33 +70,25 @@ public:
               const std::array<std::size_t, 1>& block)
         : m_space(space),
           m_windowBits(space.param()[0]),
+          m_signedDigits(space.param().size() > 1 && space.param()[1]),
           m_block(block),
-          m_powers_of_g(space.indexSize(m_block)[0],
-                        std::vector<GROUP>(windowSize(), GROUP::zero()))
+          m_numRows(space.indexSize(m_block)[0]),
+          m_powers_of_g(m_numRows * windowSize(), GROUP::zero()),
+          m_special(false)
     {
         GROUP outerG = GROUP::one();
         const std::size_t startLen = startRow() * m_windowBits;
         for (std::size_t i = 0; i < startLen; ++i)
             outerG = outerG + outerG;
 
-        const std::size_t N = m_powers_of_g.size();
+        const std::size_t N = m_numRows;
         const bool lastBlock = block[0] == space.blockID()[0] - 1;
 
         // iterate over window rows
         for (std::size_t outer = 0; outer < N; ++outer) {
-            GROUP innerG = GROUP::zero();
-
             const bool lastRow = lastBlock && outer == N - 1;
 
-            const std::size_t cur_in_window = lastRow
-                ? lastInWindow()
-                : m_powers_of_g[outer].size();
-
-            // iterate inside window
-            for (std::size_t inner = 0; inner < cur_in_window; ++inner) {
-                m_powers_of_g[outer][inner] = innerG;
-                innerG = innerG + outerG;
-            }
+            fillRow(outer, outerG, lastRow);
 
             if (! lastRow) {
                 for (std::size_t i = 0; i < m_windowBits; ++i)
@@ -96,13 +105,22 @@ public:
     // monolithic version with progress bar
     WindowExp(const std::size_t expCount,
               ProgressCallback* callback = nullptr)
-        : m_space(space(expCount)),
+        : WindowExp{expCount, false, callback}
+    {}
+
+    // monolithic version, optional signed-digit table
+    WindowExp(const std::size_t expCount,
+              const bool signedDigits,
+              ProgressCallback* callback = nullptr)
+        : m_space(space(expCount, signedDigits)),
           m_windowBits(m_space.param()[0]),
+          m_signedDigits(signedDigits),
           m_block{0},
-          m_powers_of_g(m_space.indexSize(m_block)[0],
-                        std::vector<GROUP>(windowSize(), GROUP::zero()))
+          m_numRows(m_space.indexSize(m_block)[0]),
+          m_powers_of_g(m_numRows * windowSize(), GROUP::zero()),
+          m_special(false)
     {
-        const std::size_t N = m_powers_of_g.size();
+        const std::size_t N = m_numRows;
         const std::size_t M = callback ? callback->minorSteps() : 0;
 
         GROUP outerG = GROUP::one();
@@ -112,18 +130,9 @@ public:
         // full blocks
         for (std::size_t j = 0; j < M; ++j) {
             for (std::size_t k = 0; k < N / M; ++k) {
-                GROUP innerG = GROUP::zero();
-
                 const bool lastRow = (outer == N - 1);
 
-                const std::size_t cur_in_window = lastRow
-                    ? lastInWindow()
-                    : m_powers_of_g[outer].size();
-
-                for (std::size_t inner = 0; inner < cur_in_window; ++inner) {
-                    m_powers_of_g[outer][inner] = innerG;
-                    innerG = innerG + outerG;
-                }
+                fillRow(outer, outerG, lastRow);
 
                 if (! lastRow) {
                     for (std::size_t i = 0; i < m_windowBits; ++i)
@@ -138,18 +147,9 @@ public:
 
         // remaining steps smaller than one block
         while (outer < N) {
-            GROUP innerG = GROUP::zero();
-
             const bool lastRow = (outer == N - 1);
 
-            const std::size_t cur_in_window = lastRow
-                ? lastInWindow()
-                : m_powers_of_g[outer].size();
-
-            for (std::size_t inner = 0; inner < cur_in_window; ++inner) {
-                m_powers_of_g[outer][inner] = innerG;
-                innerG = innerG + outerG;
-            }
+            fillRow(outer, outerG, lastRow);
 
             if (! lastRow) {
                 for (std::size_t i = 0; i < m_windowBits; ++i)
@@ -160,27 +160,88 @@ public:
         }
     }
 
+    // monolithic version, rows are filled in parallel
+    WindowExp(const std::size_t expCount,
+              ThreadPool& pool,
+              ProgressCallback* callback = nullptr)
+        : WindowExp{expCount, false, pool, callback}
+    {}
+
+    // monolithic version, rows are filled in parallel
+    WindowExp(const std::size_t expCount,
+              const bool signedDigits,
+              ThreadPool& pool,
+              ProgressCallback* callback = nullptr)
+        : m_space(space(expCount, signedDigits)),
+          m_windowBits(m_space.param()[0]),
+          m_signedDigits(signedDigits),
+          m_block{0},
+          m_numRows(m_space.indexSize(m_block)[0]),
+          m_powers_of_g(m_numRows * windowSize(), GROUP::zero()),
+          m_special(false)
+    {
+        ProgressCallback_Blocks blockCB(callback,
+                                        std::min(m_numRows, pool.numThreads()));
+
+        ProgressCallback* cb = callback ? std::addressof(blockCB) : nullptr;
+
+        pool.blockPartition(
+            m_numRows,
+            [this, cb] (const std::size_t,
+                        const std::size_t startIndex,
+                        const std::size_t stopIndex) {
+                fillRows(startIndex, stopIndex, cb);
+            });
+    }
+
     // works for both map-reduce and monolithic versions
     GROUP exp(const Fr& exponent) const {
-        const auto pow_val = exponent[0].asBigInt();
-        GROUP res = GROUP::zero();
+#ifdef USE_ASSERT
+        assert(m_numRows <= MAX_ROWS);
+#endif
+        std::array<Digit, MAX_ROWS> digits;
+        windowDigits(exponent[0].asBigInt(), digits.data());
 
-        const std::size_t offset = startRow();
-        for (std::size_t j = 0; j < m_powers_of_g.size(); ++j) {
-            const std::size_t outer = offset + j;
+        return expDigits(digits.data());
+    }
+
+    // calls func(k, exp(exponent(k))) for k in [0, n)
+    // Exponents are decoded in batches to a matrix of window digits,
+    // then the table walk only uses the digits.
+    template <typename EXP, typename FUNC>
+    void batchWalk(const std::size_t n,
+                   EXP exponent,
+                   FUNC func) const
+    {
+        const std::size_t batchSize = 256;
+
+        std::vector<Digit> digits(std::min(batchSize, n) * m_numRows);
 
-            std::size_t inner = 0;
-            for (std::size_t i = 0; i < m_windowBits; ++i) {
-                if (pow_val.testBit(outer * m_windowBits + i))
-                    inner |= 1u << i;
+        for (std::size_t i = 0; i < n; i += batchSize) {
+            const std::size_t m = std::min(batchSize, n - i);
+
+            // decode batch out of Montgomery form
+            for (std::size_t k = 0; k < m; ++k) {
+                windowDigits(exponent(i + k)[0].asBigInt(),
+                             digits.data() + k * m_numRows);
             }
 
-            res = res + m_powers_of_g[j][inner];
+            // table walk
+            for (std::size_t k = 0; k < m; ++k) {
+                func(i + k, expDigits(digits.data() + k * m_numRows));
+            }
         }
+    }
 
-        return res;
+    // convert table entries to special (affine) form, i.e. Z = 1
+    // then exp() uses mixed addition
+    void batchSpecial() {
+        snarklib::batchSpecial(m_powers_of_g);
+        m_special = true;
     }
 
+    bool special() const { return m_special; }
+
     // works for both map-reduce and monolithic versions
     std::vector<GROUP> batchExp(const std::vector<Fr>& exponentVec,
                                 ProgressCallback* callback = nullptr) const
@@ -190,23 +251,22 @@ public:
 
         std::vector<GROUP> res(N, GROUP::zero());
 
+        const auto func = [&res] (const std::size_t i, const GROUP& a) {
+            res[i] = a;
+        };
+
         std::size_t i = 0;
 
         // for full blocks
         for (std::size_t j = 0; j < M; ++j) {
-            for (std::size_t k = 0; k < N / M; ++k) {
-                res[i] = exp(exponentVec[i]);
-                ++i;
-            }
+            batchWalk(exponentVec, i, i + N / M, func);
+            i += N / M;
 
             callback->minor();
         }
 
         // remaining steps smaller than one block
-        while (i < N) {
-            res[i] = exp(exponentVec[i]);
-            ++i;
-        }
+        batchWalk(exponentVec, i, N, func);
 
         return res;
     }
@@ -223,23 +283,22 @@ public:
         const std::size_t N = exponentVec.size();
         const std::size_t M = callback ? callback->minorSteps() : 0;
 
+        const auto func = [&res] (const std::size_t i, const GROUP& a) {
+            res[i] = res[i] + a;
+        };
+
         std::size_t i = 0;
 
         // for full blocks
         for (std::size_t j = 0; j < M; ++j) {
-            for (std::size_t k = 0; k < N / M; ++k) {
-                res[i] = res[i] + exp(exponentVec[i]);
-                ++i;
-            }
+            batchWalk(exponentVec, i, i + N / M, func);
+            i += N / M;
 
             callback->minor();
         }
 
         // remaining steps smaller than one block
-        while (i < N) {
-            res[i] = res[i] + exp(exponentVec[i]);
-            ++i;
-        }
+        batchWalk(exponentVec, i, N, func);
     }
 
     // works for both map-reduce and monolithic versions
@@ -252,23 +311,22 @@ public:
 
         BlockVector<GROUP> res(exponentVec.space(), exponentVec.block());
 
+        const auto func = [&res] (const std::size_t i, const GROUP& a) {
+            res[i] = a;
+        };
+
         std::size_t i = exponentVec.startIndex();
 
         // for full blocks
         for (std::size_t j = 0; j < M; ++j) {
-            for (std::size_t k = 0; k < N / M; ++k) {
-                res[i] = exp(exponentVec[i]);
-                ++i;
-            }
+            batchWalk(exponentVec, i, i + N / M, func);
+            i += N / M;
 
             callback->minor();
         }
 
         // remaining steps smaller than one block
-        while (i < exponentVec.stopIndex()) {
-            res[i] = exp(exponentVec[i]);
-            ++i;
-        }
+        batchWalk(exponentVec, i, exponentVec.stopIndex(), func);
 
         return res;
     }
@@ -287,45 +345,293 @@ public:
         const std::size_t N = exponentVec.size();
         const std::size_t M = callback ? callback->minorSteps() : 0;
 
+        const auto func = [&res] (const std::size_t i, const GROUP& a) {
+            res[i] = res[i] + a;
+        };
+
         std::size_t i = exponentVec.startIndex();
 
         // for full blocks
         for (std::size_t j = 0; j < M; ++j) {
-            for (std::size_t k = 0; k < N / M; ++k) {
-                res[i] = res[i] + exp(exponentVec[i]);
-                ++i;
-            }
+            batchWalk(exponentVec, i, i + N / M, func);
+            i += N / M;
 
             callback->minor();
         }
 
         // remaining steps smaller than one block
-        while (i < exponentVec.stopIndex()) {
-            res[i] = res[i] + exp(exponentVec[i]);
-            ++i;
-        }
+        batchWalk(exponentVec, i, exponentVec.stopIndex(), func);
+    }
+
+    // multi-threaded versions of batchExp()
+    // Each thread has a contiguous range of the exponent vector.
+
+    std::vector<GROUP> batchExp(const std::vector<Fr>& exponentVec,
+                                ThreadPool& pool,
+                                ProgressCallback* callback = nullptr) const
+    {
+        std::vector<GROUP> res(exponentVec.size(), GROUP::zero());
+
+        parallelExp(
+            0, exponentVec.size(), pool, callback,
+            exponentVec,
+            [&res] (const std::size_t i, const GROUP& a) {
+                res[i] = a;
+            });
+
+        return res;
+    }
+
+    void batchExp(std::vector<GROUP>& res,
+                  const std::vector<Fr>& exponentVec,
+                  ThreadPool& pool,
+                  ProgressCallback* callback = nullptr) const
+    {
+#ifdef USE_ASSERT
+        assert(res.size() == exponentVec.size());
+#endif
+
+        parallelExp(
+            0, exponentVec.size(), pool, callback,
+            exponentVec,
+            [&res] (const std::size_t i, const GROUP& a) {
+                res[i] = res[i] + a;
+            });
+    }
+
+    BlockVector<GROUP> batchExp(const BlockVector<Fr>& exponentVec,
+                                ThreadPool& pool,
+                                ProgressCallback* callback = nullptr) const
+    {
+        BlockVector<GROUP> res(exponentVec.space(), exponentVec.block());
+
+        parallelExp(
+            exponentVec.startIndex(), exponentVec.stopIndex(), pool, callback,
+            exponentVec,
+            [&res] (const std::size_t i, const GROUP& a) {
+                res[i] = a;
+            });
+
+        return res;
+    }
+
+    void batchExp(BlockVector<GROUP>& res,
+                  const BlockVector<Fr>& exponentVec,
+                  ThreadPool& pool,
+                  ProgressCallback* callback = nullptr) const
+    {
+#ifdef USE_ASSERT
+        assert(res.space() == exponentVec.space() &&
+               res.block() == exponentVec.block());
+#endif
+
+        parallelExp(
+            exponentVec.startIndex(), exponentVec.stopIndex(), pool, callback,
+            exponentVec,
+            [&res] (const std::size_t i, const GROUP& a) {
+                res[i] = res[i] + a;
+            });
     }
 
 private:
+    // batchWalk() on thread pool, one range of [startIndex, stopIndex)
+    // for each thread
+    template <typename VEC, typename FUNC>
+    void parallelExp(const std::size_t startIndex,
+                     const std::size_t stopIndex,
+                     ThreadPool& pool,
+                     ProgressCallback* callback,
+                     const VEC& exponentVec,
+                     FUNC func) const
+    {
+        ProgressCounter progress(callback, stopIndex - startIndex);
+
+        pool.blockPartition(
+            stopIndex - startIndex,
+            [this, startIndex, &exponentVec, &progress, &func]
+            (const std::size_t,
+             const std::size_t a,
+             const std::size_t b) {
+                batchWalk(exponentVec,
+                          startIndex + a,
+                          startIndex + b,
+                          [&progress, &func] (const std::size_t i, const GROUP& x) {
+                              func(i, x);
+                              progress.step();
+                          });
+            });
+
+        progress.finish();
+    }
+
+    // calls func(i, exp(exponentVec[i])) for i in [startIndex, stopIndex)
+    template <typename VEC, typename FUNC>
+    void batchWalk(const VEC& exponentVec,
+                   const std::size_t startIndex,
+                   const std::size_t stopIndex,
+                   FUNC func) const
+    {
+        batchWalk(stopIndex - startIndex,
+                  [&exponentVec, startIndex] (const std::size_t k) -> const Fr& {
+                      return exponentVec[startIndex + k];
+                  },
+                  [&func, startIndex] (const std::size_t k, const GROUP& a) {
+                      func(startIndex + k, a);
+                  });
+    }
+
+    // window digits for rows of this table, unsigned digits are the
+    // table row index and signed digits are negative to subtract
+    template <typename T>
+    void windowDigits(const T& pow_val, Digit* digits) const {
+        const std::size_t offset = startRow();
+
+        if (! m_signedDigits) {
+            for (std::size_t j = 0; j < m_numRows; ++j) {
+                digits[j] = pow_val.getBits((offset + j) * m_windowBits, m_windowBits);
+            }
+
+            return;
+        }
+
+        // signed digits are recoded from the least significant window
+        // so the carry into this block depends on all rows before it
+        const long
+            half = 1l << (m_windowBits - 1),
+            full = 1l << m_windowBits;
+
+        const std::size_t lastWindow = numWindows() - 1;
+
+        long carry = 0;
+        for (std::size_t outer = 0; outer < offset + m_numRows; ++outer) {
+            const long v
+                = pow_val.getBits(outer * m_windowBits, m_windowBits) + carry;
+
+            long d;
+            if (v > half && outer != lastWindow) {
+                d = v - full;
+                carry = 1;
+            } else {
+                d = v;
+                carry = 0;
+            }
+
+            if (outer >= offset) digits[outer - offset] = d;
+        }
+    }
+
+    GROUP expDigits(const Digit* digits) const {
+        const std::size_t rowSize = windowSize();
+
+        GROUP res = GROUP::zero();
+
+        for (std::size_t j = 0; j < m_numRows; ++j) {
+            const GROUP* row = m_powers_of_g.data() + j * rowSize;
+            const Digit d = digits[j];
+
+            if (! m_signedDigits) {
+                res = addEntry(res, row[d]);
+
+            } else if (d > 0) {
+                res = addEntry(res, row[d - 1]);
+
+            } else if (d < 0) {
+                res = addEntry(res, -row[-d - 1]);
+            }
+        }
+
+        return res;
+    }
+
     static std::size_t numBits() {
         return GROUP::ScalarField::BaseType::sizeInBits();
     }
 
-    static std::size_t numWindows(const std::size_t windowbits) {
-        return (numBits() + windowbits - 1) / windowbits;
+    // signed digits may carry out of the most significant window
+    static std::size_t numWindows(const std::size_t windowbits,
+                                  const bool signedDigits = false) {
+        return signedDigits
+            ? (numBits() + windowbits) / windowbits
+            : (numBits() + windowbits - 1) / windowbits;
     }
 
-    static std::size_t windowSize(const std::size_t windowbits) {
-        return 1u << windowbits;
+    static std::size_t windowSize(const std::size_t windowbits,
+                                  const bool signedDigits = false) {
+        return signedDigits
+            ? 1u << (windowbits - 1)
+            : 1u << windowbits;
+    }
+
+    // last window has fewer bits and the largest signed digit is the
+    // carry plus those bits
+    static std::size_t lastInWindow(const std::size_t windowbits,
+                                    const bool signedDigits = false) {
+        return 1u << (numBits() - (numWindows(windowbits, signedDigits) - 1) * windowbits);
+    }
+
+    std::size_t numWindows() const { return numWindows(m_windowBits, m_signedDigits); }
+    std::size_t windowSize() const { return windowSize(m_windowBits, m_signedDigits); }
+    std::size_t lastInWindow() const { return lastInWindow(m_windowBits, m_signedDigits); }
+
+    // unsigned row is 0, G, 2G,... and signed row is G, 2G, 3G,...
+    void fillRow(const std::size_t outer,
+                 const GROUP& outerG,
+                 const bool lastRow)
+    {
+        GROUP innerG = m_signedDigits ? outerG : GROUP::zero();
+
+        const std::size_t rowSize = windowSize();
+
+        const std::size_t cur_in_window = lastRow
+            ? std::min(lastInWindow(), rowSize)
+            : rowSize;
+
+        GROUP* row = m_powers_of_g.data() + outer * rowSize;
+
+        // iterate inside window
+        for (std::size_t inner = 0; inner < cur_in_window; ++inner) {
+            row[inner] = innerG;
+            innerG = innerG + outerG;
+        }
     }
 
-    static std::size_t lastInWindow(const std::size_t windowbits) {
-        return 1u << (numBits() - (numWindows(windowbits) - 1) * windowbits);
+    // rows [startIndex, stopIndex) of monolithic table, each thread
+    // doubles its own starting outerG
+    void fillRows(const std::size_t startIndex,
+                  const std::size_t stopIndex,
+                  ProgressCallback* callback)
+    {
+        const std::size_t M = callback ? callback->minorSteps() : 0;
+        std::size_t callbackCount = 0;
+
+        GROUP outerG = GROUP::one();
+        const std::size_t startLen = startIndex * m_windowBits;
+        for (std::size_t i = 0; i < startLen; ++i)
+            outerG = outerG + outerG;
+
+        for (std::size_t outer = startIndex; outer < stopIndex; ++outer) {
+            const bool lastRow = (outer == m_numRows - 1);
+
+            fillRow(outer, outerG, lastRow);
+
+            if (! lastRow) {
+                for (std::size_t i = 0; i < m_windowBits; ++i)
+                    outerG = outerG + outerG;
+            }
+
+            while (callbackCount < M * (outer - startIndex + 1) / (stopIndex - startIndex)) {
+                ++callbackCount;
+                callback->minor();
+            }
+        }
     }
 
-    std::size_t numWindows() const { return numWindows(m_windowBits); }
-    std::size_t windowSize() const { return windowSize(m_windowBits); }
-    std::size_t lastInWindow() const { return lastInWindow(m_windowBits); }
+    // mixed addition if table is special (negated entries are too)
+    GROUP addEntry(const GROUP& a, const GROUP& b) const {
+        return m_special
+            ? fastAddSpecial(a, b)
+            : a + b;
+    }
 
     std::size_t startRow() const {
         return m_space.indexOffset(m_block)[0];
@@ -333,8 +639,13 @@ private:
 
     const IndexSpace<1> m_space;
     const std::size_t m_windowBits;
+    const bool m_signedDigits;
     const std::array<std::size_t, 1> m_block;
-    std::vector<std::vector<GROUP>> m_powers_of_g;
+
+    // rows of window table are contiguous
+    const std::size_t m_numRows;
+    std::vector<GROUP, CacheAlignedAllocator<GROUP>> m_powers_of_g;
+    bool m_special;
 };
 
 } // namespace snarklib
@@ -7,6 +7,7 @@
 #include <random>
 #include <sstream>
 #include <string>
+#include <type_traits>
 #include <unistd.h>
 #include "AutoTest.hpp"
 #include "AutoTest_BigInt.hpp"
@@ -112,6 +113,49 @@ void add_Field(AutoTestBattery& ATB)
     }
 }
 
+#ifdef SNARKLIB_MONT_KERNEL
+template <typename T>
+void add_Field_MontInverse(AutoTestBattery& ATB, std::true_type)
+{
+    // edge cases: 1, 2, p - 1
+    ATB.addTest(new AutoTest_FieldMontInverse<T>(T(1ul)));
+    ATB.addTest(new AutoTest_FieldMontInverse<T>(T(2ul)));
+    ATB.addTest(new AutoTest_FieldMontInverse<T>(-T::one()));
+
+    for (size_t i = 0; i < 10; ++i) {
+        ATB.addTest(new AutoTest_FieldMontInverse<T>);
+    }
+}
+
+template <typename T>
+void add_Field_MontInverse(AutoTestBattery& ATB, std::false_type)
+{
+    // no constant-time inversion for moduli over 256 bits
+}
+#endif
+
+template <typename T>
+void add_Field_MontKernel(AutoTestBattery& ATB)
+{
+#ifdef SNARKLIB_MONT_KERNEL
+    for (size_t i = 0; i < 10; ++i) {
+        // defined for only: Fp
+        ATB.addTest(new AutoTest_FieldMontKernel<T>);
+    }
+
+    add_Field_MontInverse<T>(ATB, HasMontInverse<T::BaseType::numberLimbs()>());
+#endif
+}
+
+template <typename T>
+void add_Field_batch(AutoTestBattery& ATB)
+{
+    for (size_t i = 0; i < 10; ++i) {
+        // lengths around the eight element vector kernel
+        ATB.addTest(new AutoTest_FieldBatch<T>(rd() % 40));
+    }
+}
+
 template <typename T, typename U>
 void add_Field_sqrt(AutoTestBattery& ATB)
 {
@@ -197,6 +241,10 @@ void add_MultiExp(AutoTestBattery& ATB)
                         randomBase10(rd, N)));
         ATB.addTest(new AutoTest_MultiExp_multiExp<N, T, F, U, G>(rd() % 100));
         ATB.addTest(new AutoTest_MultiExp_multiExp01<N, T, F, U, G>(rd() % 100));
+        ATB.addTest(new AutoTest_MultiExp_multiExpBucket<T, F>(rd() % 100));
+        ATB.addTest(new AutoTest_MultiExp_multiExpThreads<T, F>(rd() % 100, 1 + rd() % 8));
+        ATB.addTest(new AutoTest_MultiExp_threadPoolException<T, F>(rd() % 100, 1 + rd() % 8));
+        ATB.addTest(new AutoTest_MultiExp_multiExpRange<T, F>(rd() % 100, rd() % 10));
     }
 }
 
@@ -213,6 +261,11 @@ void add_LagrangeFFT(AutoTestBattery& ATB)
         ATB.addTest(new AutoTest_LagrangeFFT_compute_Z<T, U>(2 + rd() % 100));
         ATB.addTest(new AutoTest_LagrangeFFT_add_poly_Z<T, U>(2 + rd() % 100));
         ATB.addTest(new AutoTest_LagrangeFFT_divide_by_Z_on_coset<T, U>(2 + rd() % 100));
+        ATB.addTest(new AutoTest_LagrangeFFT_FFTThreads<T, U>(2 + rd() % 1000, 1 + rd() % 8));
+        ATB.addTest(new AutoTest_LagrangeFFT_cosetGenerator<T, U>(2 + rd() % 1000, 1 + rd() % 8));
+        ATB.addTest(new AutoTest_LagrangeFFT_FourStep<T, U>(1u << (1 + rd() % 10)));
+        ATB.addTest(new AutoTest_LagrangeFFT_batchFFT<T>(2 + rd() % 100, 1 + rd() % 4));
+        ATB.addTest(new AutoTest_LagrangeFFT_domainCache<T>(2 + rd() % 100, 1 + rd() % 8));
     }
 }
 
@@ -229,6 +282,13 @@ void add_WindowExp(AutoTestBattery& ATB)
 
     for (size_t i = 0; i < 2; ++i) {
         ATB.addTest(new AutoTest_WindowExp_expMapReduce<T, F>(1 + rd() % 100));
+        ATB.addTest(new AutoTest_WindowExp_expSigned<T, F>(1 + rd() % 100));
+        ATB.addTest(new AutoTest_WindowExp_expSpecial<T, F>(1 + rd() % 100));
+        ATB.addTest(new AutoTest_WindowExp_expThreads<T, F>(1 + rd() % 100, 1 + rd() % 8));
+        ATB.addTest(new AutoTest_WindowExp_batchExpThreads<T, F>(
+                        1 + rd() % 100,
+                        1 + rd() % 10,
+                        1 + rd() % 8));
         ATB.addTest(new AutoTest_WindowExp_batchExpMapReduce1<T, F>(
                         1 + rd() % 100,
                         1 + rd() % 10));
@@ -267,6 +327,9 @@ void add_Pairing(AutoTestBattery& ATB)
                         1 + rd() % 10));
         ATB.addTest(new AutoTest_Pairing_multiExp01<N, TG, TH, TF, UG, UH, UF>(
                         1 + rd() % 100));
+        ATB.addTest(new AutoTest_Pairing_multiExp01Threads<TG, TH, TF>(
+                        1 + rd() % 100,
+                        1 + rd() % 8));
     }
 
     for (size_t i = 0; i < 2; ++i) {
@@ -295,6 +358,9 @@ void add_QAP(AutoTestBattery& ATB)
                 for (const auto& cs : csvec) {
                     ATB.addTest(new AutoTest_QAP_ABCH_instance_map<T, U>(cs));
                     ATB.addTest(new AutoTest_QAP_Witness_map<T, U>(cs));
+                    ATB.addTest(new AutoTest_QAP_WitnessH_inPlace<T, U>(cs));
+                    ATB.addTest(new AutoTest_QAP_QueryThreads<T, U>(cs, 1 + rd() % 8));
+                    ATB.addTest(new AutoTest_QAP_WitnessFillABC<T, U>(cs, 1 + rd() % 8));
                 }
             }
         }
@@ -402,6 +468,11 @@ int main(int argc, char *argv[])
     add_Field<NRQ, Fq, libsnark_Fq>(ATB);
     add_Field<NRQ, Fqe, libsnark_Fqe>(ATB);
     add_Field<NRQ, Fqk, libsnark_Fqk>(ATB);
+    add_Field_MontKernel<Fr>(ATB);
+    add_Field_MontKernel<Fq>(ATB);
+    add_Field_batch<Fr>(ATB);
+    add_Field_batch<Fq>(ATB);
+    add_Field_batch<Fqe>(ATB);
     add_Field_sqrt<Fr, libsnark_Fr>(ATB);
     add_Field_sqrt<Fq, libsnark_Fq>(ATB);
     add_Field_sqrt<Fqe, libsnark_Fqe>(ATB);